@@ -7,6 +7,8 @@
 #   - SYS_ADMIN: Enables the container to perform system administration tasks (PingPong eBPF functionalities require this for correct functioning).
 #   - BPF: Allows the container to load eBPF programs (PingPong uses this for loading eBPF programs).
 #   - PERFMON: Required for performance monitoring (PingPong eBPF functionalities require this for correct functioning).
+# With TIMESTAMPING=1, pingpong-ebpf is not started and the client/server record
+# SO_TIMESTAMPING stamps instead, so SYS_ADMIN, BPF and PERFMON are not needed.
 # During the first run, you may need to set up the credentials for Tailscale manually.
 
 # Exit the script immediately if any command fails
@@ -15,6 +17,14 @@ set -ex
 ROLE="${ROLE:-server}"  # Default role is 'server' if not set
 CONTROL_PORT="${CONTROL_PORT:-4242}"  # Default control port is 4242 if not set
 EXP_PORT="${EXP_PORT:-24242}"  # Default experiment port is 4243 if not set
+TIMESTAMPING="${TIMESTAMPING:-0}"  # Use SO_TIMESTAMPING instead of eBPF if set to 1
+SERVER_OUTPUT="${SERVER_OUTPUT:-/var/lib/pingpong/server.csv}"  # Server-side breakdown in SO_TIMESTAMPING mode
+IO_BACKEND="${IO_BACKEND:-blocking}"  # Experiment I/O backend: 'blocking' or 'uring'
+DURATION="${DURATION:-}"  # Soak mode: run the client for this many seconds instead of COUNT iterations
+TAIL_THRESHOLD_US="${TAIL_THRESHOLD_US:-0}"  # Soak mode: keep raw samples of windows with a slower p99
+ROTATE_MB="${ROTATE_MB:-256}"  # Rotate and compress the eBPF log (and soak outputs) at this size
+KEEP_FILES="${KEEP_FILES:-8}"  # Number of rotated files to keep
+EBPF_LOG_ARGS="--output /var/lib/pingpong/ebpf.log --rotate-size $ROTATE_MB --keep $KEEP_FILES"
 
 if [ "$ROLE" != "server" ] && [ "$ROLE" != "client" ] && [ "$ROLE" != "idle" ]; then
     echo "ERROR: Invalid ROLE specified. Must be 'server' or 'client'."
@@ -63,14 +73,24 @@ tailscale up
 
 if [ "$ROLE" == "server" ]; then
     echo "Starting PingPong server..."
-    # Start the PingPong eBPF component in the background
-    pingpong-ebpf --sport $EXP_PORT > /var/lib/pingpong/ebpf.log 2> /var/lib/pingpong/ebpf.stderr &
+    if [ "$TIMESTAMPING" == "1" ]; then
+        echo "INFO: SO_TIMESTAMPING mode, not starting the PingPong eBPF component."
+    else
+        # Start the PingPong eBPF component in the background
+        pingpong-ebpf --sport $EXP_PORT $EBPF_LOG_ARGS 2> /var/lib/pingpong/ebpf.stderr &
+    fi
     # Start the PingPong server in the foreground
-    pingpong-server --port $CONTROL_PORT
+    pingpong-server --port $CONTROL_PORT --output $SERVER_OUTPUT --io $IO_BACKEND
 else
     echo "Starting PingPong client..."
-    # Start the PingPong eBPF component in the background
-    pingpong-ebpf --dport $EXP_PORT > /var/lib/pingpong/ebpf.log 2> /var/lib/pingpong/ebpf.stderr &
+    CLIENT_EXTRA_ARGS=""
+    if [ "$TIMESTAMPING" == "1" ]; then
+        echo "INFO: SO_TIMESTAMPING mode, not starting the PingPong eBPF component."
+        CLIENT_EXTRA_ARGS="--timestamping"
+    else
+        # Start the PingPong eBPF component in the background
+        pingpong-ebpf --dport $EXP_PORT $EBPF_LOG_ARGS 2> /var/lib/pingpong/ebpf.stderr &
+    fi
     # Start the PingPong client in the foreground
     if [ -z "$SERVER_ADDR" ]; then
         echo "SERVER_ADDR environment variable is not set. Please enter the server address:"
@@ -80,7 +100,12 @@ else
             exit 1
         fi
     fi
-    pingpong-client --control-port $CONTROL_PORT --exp-port $EXP_PORT --addr $SERVER_ADDR --size $SIZE --count $COUNT --output $CLIENT_OUTPUT
+    if [ -n "$DURATION" ]; then
+        RUN_ARGS="--duration $DURATION --tail-threshold-us $TAIL_THRESHOLD_US --rotate-size $ROTATE_MB --keep $KEEP_FILES"
+    else
+        RUN_ARGS="--count $COUNT"
+    fi
+    pingpong-client --control-port $CONTROL_PORT --exp-port $EXP_PORT --addr $SERVER_ADDR --size $SIZE $RUN_ARGS --output $CLIENT_OUTPUT --io $IO_BACKEND $CLIENT_EXTRA_ARGS
 fi
 
 echo "Test completed. Please check the logs for details."
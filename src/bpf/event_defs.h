@@ -5,18 +5,63 @@
 #define EVENT_TYPE_TCP_RECV 2
 #define EVENT_TYPE_TCP_SEND_EXIT 3
 #define EVENT_TYPE_TCP_RECV_EXIT 4
+#define EVENT_TYPE_SCHED_WAKEUP 5 // receiving thread made runnable
+#define EVENT_TYPE_SCHED_SWITCH 6 // receiving thread switched onto a CPU
+#define EVENT_TYPE_SOCK_META 0x80 // struct sock_meta record, not an event
+
+// maximum number of processes the scheduler probes can be restricted to
+#define MAX_SCHED_PIDS 64
+
+// config.flags bits
+#define CONFIG_F_SCHED_PID_FILTER (1U << 0) // match sched events against sched_pids instead of comm
+#define CONFIG_F_EARLY_OUT (1U << 1)        // hooks return right after reading the config
+#define CONFIG_F_SELF_TIME (1U << 2)        // hooks record their own run time in hook_stats
+#define CONFIG_F_FORCE_PORTS (1U << 3)      // port filters also drop sockets with unset ports
+
+// hook_stats layout: one log2 histogram of run time (ns) per event type
+#define HOOK_COUNT EVENT_TYPE_SCHED_SWITCH
+#define HOOK_STAT_BUCKETS 32
+
+// execution context of a hook (struct event ctx)
+#define EVENT_CTX_PROCESS 0
+#define EVENT_CTX_SOFTIRQ 1
+#define EVENT_CTX_HARDIRQ 2
+#define EVENT_CTX_NMI 3
+
+// sockets whose metadata the kernel remembers (LRU) before re-emitting it
+#define SOCK_META_ENTRIES 4096
 
 // common max for IPv6 address
 #define ADDR_V6_WORDS 4
 
+// Every ring buffer record starts with its type byte so user space can tell
+// per-hook events from socket metadata records.
+
+// Per-hook record; endpoints live in the socket's sock_meta record
 struct event
 {
+    __u8 event_type; // EVENT_TYPE_*
+    __u8 ctx;      // EVENT_CTX_*
+    __u16 cpu;     // CPU the hook ran on
+    __u32 pid;     // thread id
     __u64 timestamp_ns;
-    __u32 pid;
-    __u16 sport;
-    __u16 dport;
-    __u8 event_type; // 1 for send, 2 for receive
+    __u64 sock_id; // cast of (u64) sk pointer, 0 for scheduler events
+    __u32 srtt_us; // smoothed round trip time in microseconds
+    __u32 pad2;
+};
+
+// Endpoints of a socket, emitted the first time the socket is seen and again
+// whenever its port pair changes (e.g. an address reused by a new socket)
+struct sock_meta
+{
+    __u8 event_type; // EVENT_TYPE_SOCK_META
     __u8 af;         // address family: AF_INET or AF_INET6
+    __u16 sport;     // host order
+    __u16 dport;     // host order
+    __u16 pad;
+    __u32 portpair;  // raw skc_portpair, compared on every hook
+    __u32 pad2;
+    __u64 sock_id;
     union
     {
         __u32 v4;
@@ -27,8 +72,14 @@ struct event
         __u32 v4;
         __u32 v6[ADDR_V6_WORDS];
     } daddr;
-    __u64 sock_id; // NEW: cast of (u64) sk pointer
-    __u32 srtt_us; // smoothed round trip time in microseconds
+};
+
+// Runtime settings shared with the BPF programs through the config map
+struct pingpong_config
+{
+    __u32 flags;
+    __u16 sport; // socket events must match this local port (host order), 0 for any
+    __u16 dport; // socket events must match this remote port (host order), 0 for any
 };
 
 #endif /* __EVENT_DEFS_H */
\ No newline at end of file
@@ -19,25 +19,221 @@ struct
     __uint(max_entries, 16 * 1024 * 1024); // 16 MiB
 } events SEC(".maps");
 
+// Socket metadata already emitted, keyed by sock_id
+struct
+{
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, SOCK_META_ENTRIES);
+    __type(key, __u64);
+    __type(value, struct sock_meta);
+} sock_meta SEC(".maps");
+
+// Single-entry array holding struct pingpong_config, written by user space
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct pingpong_config);
+} config SEC(".maps");
+
+// Processes (tgid) the scheduler probes report on when CONFIG_F_SCHED_PID_FILTER is set
+struct
+{
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_SCHED_PIDS);
+    __type(key, __u32);
+    __type(value, __u8);
+} sched_pids SEC(".maps");
+
+// Per-CPU hook run time histograms, indexed by (event_type - 1) * HOOK_STAT_BUCKETS + log2(ns)
+struct
+{
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, HOOK_COUNT * HOOK_STAT_BUCKETS);
+    __type(key, __u32);
+    __type(value, __u64);
+} hook_stats SEC(".maps");
+
+// preempt_count layout <https://github.com/torvalds/linux/blob/master/include/linux/preempt.h>
+#define PC_SOFTIRQ_OFFSET 0x00000100
+#define PC_HARDIRQ_MASK 0x000f0000
+#define PC_NMI_MASK 0x00f00000
+
+#if defined(bpf_target_x86)
+// Per-CPU preempt count: a variable of its own, or part of pcpu_hot on v6.1..v6.14
+extern const int __preempt_count __ksym __weak;
+
+struct pcpu_hot___local
+{
+    int preempt_count;
+} __attribute__((preserve_access_index));
+
+extern struct pcpu_hot___local pcpu_hot __ksym __weak;
+#endif
+
+static __always_inline int get_preempt_count(void)
+{
+#if defined(bpf_target_x86)
+    if (bpf_ksym_exists(&__preempt_count))
+        return *(int *)bpf_this_cpu_ptr(&__preempt_count);
+    if (bpf_core_field_exists(pcpu_hot.preempt_count))
+        return ((struct pcpu_hot___local *)bpf_this_cpu_ptr(&pcpu_hot))->preempt_count;
+#elif defined(bpf_target_arm64)
+    return bpf_get_current_task_btf()->thread_info.preempt_count;
+#endif
+    return 0;
+}
+
+// Whether the hook runs in a task or on behalf of an interrupt. On PREEMPT_RT
+// softirqs run in threads and are reported as process context.
+static __always_inline __u8 exec_context(void)
+{
+    int pc = get_preempt_count();
+
+    if (pc & PC_NMI_MASK)
+        return EVENT_CTX_NMI;
+    if (pc & PC_HARDIRQ_MASK)
+        return EVENT_CTX_HARDIRQ;
+    if (pc & PC_SOFTIRQ_OFFSET)
+        return EVENT_CTX_SOFTIRQ;
+    return EVENT_CTX_PROCESS;
+}
+
+static __always_inline struct pingpong_config *get_config(void)
+{
+    __u32 key = 0;
+    return bpf_map_lookup_elem(&config, &key);
+}
+
+static __always_inline __u32 log2_u64(__u64 v)
+{
+    __u32 r = 0;
+
+    if (v >> 32)
+    {
+        v >>= 32;
+        r += 32;
+    }
+    if (v >> 16)
+    {
+        v >>= 16;
+        r += 16;
+    }
+    if (v >> 8)
+    {
+        v >>= 8;
+        r += 8;
+    }
+    if (v >> 4)
+    {
+        v >>= 4;
+        r += 4;
+    }
+    if (v >> 2)
+    {
+        v >>= 2;
+        r += 2;
+    }
+    if (v >> 1)
+        r += 1;
+    return r;
+}
+
+// Account the time since start_ns to the hook of evt_type (CONFIG_F_SELF_TIME)
+static __always_inline void record_hook_time(__u8 evt_type, __u64 start_ns)
+{
+    __u32 bucket = log2_u64(bpf_ktime_get_ns() - start_ns);
+    if (bucket >= HOOK_STAT_BUCKETS)
+        bucket = HOOK_STAT_BUCKETS - 1;
+    if (evt_type < 1 || evt_type > HOOK_COUNT)
+        return;
+
+    __u32 idx = (evt_type - 1) * HOOK_STAT_BUCKETS + bucket;
+    __u64 *count = bpf_map_lookup_elem(&hook_stats, &idx);
+    if (count)
+        (*count)++;
+}
+
+// Read the endpoints of sk once and publish them to user space
+static __always_inline void emit_sock_meta(struct sock *sk, __u64 sock_id, __u32 portpair)
+{
+    struct sock_meta m = {};
+
+    m.event_type = EVENT_TYPE_SOCK_META;
+    m.sock_id = sock_id;
+    m.portpair = portpair;
+    m.af = BPF_CORE_READ(sk, __sk_common.skc_family);
+
+    // ports in host order
+    m.sport = BPF_CORE_READ(sk, __sk_common.skc_num);
+    m.dport = bpf_ntohs(BPF_CORE_READ(sk, __sk_common.skc_dport));
+
+    if (m.af == AF_INET)
+    {
+        // IPv4
+        m.saddr.v4 = BPF_CORE_READ(sk, __sk_common.skc_rcv_saddr);
+        m.daddr.v4 = BPF_CORE_READ(sk, __sk_common.skc_daddr);
+    }
+    else if (m.af == AF_INET6)
+    {
+        // IPv6
+        BPF_CORE_READ_INTO(&m.saddr.v6, sk, __sk_common.skc_v6_rcv_saddr.in6_u.u6_addr32);
+        BPF_CORE_READ_INTO(&m.daddr.v6, sk, __sk_common.skc_v6_daddr.in6_u.u6_addr32);
+    }
+
+    bpf_map_update_elem(&sock_meta, &sock_id, &m, BPF_ANY);
+    bpf_ringbuf_output(&events, &m, sizeof(m), 0);
+}
+
+// Whether a port passes a config filter; unset ports only fail forced filters
+static __always_inline bool port_matches(__u16 port, __u16 want, __u32 flags)
+{
+    if (!want)
+        return true;
+    if (!port)
+        return !(flags & CONFIG_F_FORCE_PORTS);
+    return port == want;
+}
+
 static __always_inline void trace_sock_event(struct pt_regs *ctx, struct sock *sk, __u8 evt_type)
 {
     struct event *e;
+
+    // The early-out must come first so it measures only the trampoline and the config read
+    struct pingpong_config *cfg = get_config();
+    if (cfg && (cfg->flags & CONFIG_F_EARLY_OUT))
+        return;
+
     __u64 ts = bpf_ktime_get_ns();
     __u32 pid = bpf_get_current_pid_tgid() & 0xFFFFFFFF;
+    __u64 sock_id = (u64)sk;
+
+    // A single read of the port pair tells whether the metadata is still current
+    __u32 portpair = BPF_CORE_READ(sk, __sk_common.skc_portpair);
+
+    // skc_portpair is {__be16 skc_dport; __u16 skc_num} on the little-endian targets we build for
+    if (cfg && !(port_matches(portpair >> 16, cfg->sport, cfg->flags) &&
+                 port_matches(bpf_ntohs((__u16)portpair), cfg->dport, cfg->flags)))
+        goto out;
+
+    struct sock_meta *m = bpf_map_lookup_elem(&sock_meta, &sock_id);
+    if (!m || m->portpair != portpair)
+        emit_sock_meta(sk, sock_id, portpair);
 
     // Reserve space in the ring buffer
     e = bpf_ringbuf_reserve(&events, sizeof(*e), 0);
     if (!e)
-        return;
+        goto out;
 
-    // Populate only the minimal fields:
-    e->timestamp_ns = ts;
-    e->pid = pid;
     e->event_type = evt_type;
-    e->af = BPF_CORE_READ(sk, __sk_common.skc_family);
-
-    // NEW: emit sock_id (pointer value) for user-space pairing
-    e->sock_id = (u64)sk;
+    e->ctx = exec_context();
+    e->cpu = bpf_get_smp_processor_id();
+    e->pid = pid;
+    e->timestamp_ns = ts;
+    e->sock_id = sock_id;
+    e->srtt_us = 0;
+    e->pad2 = 0;
 
     struct tcp_sock *ts_ptr = bpf_skc_to_tcp_sock(sk);
     if (ts_ptr)
@@ -45,32 +241,72 @@ static __always_inline void trace_sock_event(struct pt_regs *ctx, struct sock *s
         e->srtt_us = BPF_CORE_READ(ts_ptr, srtt_us) >> 3;
     }
 
-    // ports in host order
-    e->sport = BPF_CORE_READ(sk, __sk_common.skc_num);
-    e->dport = bpf_ntohs(BPF_CORE_READ(sk, __sk_common.skc_dport));
+    bpf_ringbuf_submit(e, 0);
+
+out:
+    // Filtered calls are timed too, as they pay for the hook all the same
+    if (cfg && (cfg->flags & CONFIG_F_SELF_TIME))
+        record_hook_time(evt_type, ts);
+}
+
+// Without an explicit PID list, follow pingpong-client and pingpong-server by
+// name. The tracer itself ("pingpong-ebpf") is excluded, as its own wakeups
+// from ring buffer polling would otherwise flood the log.
+static __always_inline bool is_pingpong_comm(struct task_struct *p)
+{
+    const char prefix[] = "pingpong-";
+    char comm[sizeof(p->comm)];
+
+    if (bpf_core_read(comm, sizeof(comm), &p->comm))
+        return false;
 
-    if (e->af == AF_INET)
+#pragma unroll
+    for (int i = 0; i < sizeof(prefix) - 1; i++)
     {
-        // IPv4
-        e->saddr.v4 = BPF_CORE_READ(sk, __sk_common.skc_rcv_saddr);
-        e->daddr.v4 = BPF_CORE_READ(sk, __sk_common.skc_daddr);
+        if (comm[i] != prefix[i])
+            return false;
+    }
+    return comm[sizeof(prefix) - 1] == 'c' || comm[sizeof(prefix) - 1] == 's';
+}
+
+static __always_inline void trace_sched_event(struct task_struct *p, __u8 evt_type)
+{
+    struct event *e;
+    __u32 tgid;
+
+    struct pingpong_config *cfg = get_config();
+    if (cfg && (cfg->flags & CONFIG_F_EARLY_OUT))
+        return;
+
+    __u64 ts = bpf_ktime_get_ns();
+    if (cfg && (cfg->flags & CONFIG_F_SCHED_PID_FILTER))
+    {
+        tgid = BPF_CORE_READ(p, tgid);
+        if (!bpf_map_lookup_elem(&sched_pids, &tgid))
+            goto out;
     }
-    else if (e->af == AF_INET6)
+    else if (!is_pingpong_comm(p))
     {
-        // IPv6
-        __u32 *s6 = (__u32 *)&e->saddr.v6;
-        __u32 *d6 = (__u32 *)&e->daddr.v6;
-        BPF_CORE_READ_INTO(&s6[0], sk, __sk_common.skc_v6_rcv_saddr.in6_u.u6_addr32[0]);
-        BPF_CORE_READ_INTO(&s6[1], sk, __sk_common.skc_v6_rcv_saddr.in6_u.u6_addr32[1]);
-        BPF_CORE_READ_INTO(&s6[2], sk, __sk_common.skc_v6_rcv_saddr.in6_u.u6_addr32[2]);
-        BPF_CORE_READ_INTO(&s6[3], sk, __sk_common.skc_v6_rcv_saddr.in6_u.u6_addr32[3]);
-        BPF_CORE_READ_INTO(&d6[0], sk, __sk_common.skc_v6_daddr.in6_u.u6_addr32[0]);
-        BPF_CORE_READ_INTO(&d6[1], sk, __sk_common.skc_v6_daddr.in6_u.u6_addr32[1]);
-        BPF_CORE_READ_INTO(&d6[2], sk, __sk_common.skc_v6_daddr.in6_u.u6_addr32[2]);
-        BPF_CORE_READ_INTO(&d6[3], sk, __sk_common.skc_v6_daddr.in6_u.u6_addr32[3]);
+        goto out;
     }
 
+    e = bpf_ringbuf_reserve(&events, sizeof(*e), 0);
+    if (!e)
+        goto out;
+
+    // No socket is involved, so only the timestamp and thread id are meaningful
+    __builtin_memset(e, 0, sizeof(*e));
+    e->event_type = evt_type;
+    e->ctx = exec_context();
+    e->cpu = bpf_get_smp_processor_id();
+    e->pid = BPF_CORE_READ(p, pid);
+    e->timestamp_ns = ts;
+
     bpf_ringbuf_submit(e, 0);
+
+out:
+    if (cfg && (cfg->flags & CONFIG_F_SELF_TIME))
+        record_hook_time(evt_type, ts);
 }
 
 SEC("fentry/tcp_sendmsg")
@@ -103,5 +339,21 @@ int BPF_PROG(handle_tcp_recvmsg_ret, struct sock *sk)
     return 0;
 }
 
+// Optional scheduler probes (enabled with --sched): split the receive path into
+// softirq processing, wakeup-to-run delay and syscall copy-out
+SEC("tp_btf/sched_wakeup")
+int BPF_PROG(handle_sched_wakeup, struct task_struct *p)
+{
+    trace_sched_event(p, EVENT_TYPE_SCHED_WAKEUP);
+    return 0;
+}
+
+SEC("tp_btf/sched_switch")
+int BPF_PROG(handle_sched_switch, bool preempt, struct task_struct *prev, struct task_struct *next)
+{
+    trace_sched_event(next, EVENT_TYPE_SCHED_SWITCH);
+    return 0;
+}
+
 // Only GPL-compatible licenses can use all BPF features <https://github.com/torvalds/linux/blob/master/include/linux/license.h>
 char LICENSE[] SEC("license") = "GPL";
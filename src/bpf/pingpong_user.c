@@ -1,5 +1,8 @@
 #include <argp.h>
 #include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <signal.h>
 #include <stdio.h>
@@ -13,6 +16,7 @@
 #include <bpf/bpf.h>
 #include "pingpong_kern.skel.h" // Generated by bpftool gen skeleton
 #include "event_defs.h"         // Include the shared event definition
+#include "rotate.h"
 
 static struct pingpong_kern_bpf *skel = NULL;
 static struct ring_buffer *rb = NULL;
@@ -20,6 +24,37 @@ static struct ring_buffer *rb = NULL;
 static __u16 target_sport = 0; // Global variable for target sport
 static __u16 target_dport = 0; // Global variable for target dport
 static __u32 force_filter = 0; // Flag to force filtering by ports
+static bool sched_enabled = false; // Attach the scheduler probes
+
+static __u32 sched_pid_list[MAX_SCHED_PIDS]; // Processes the scheduler probes are restricted to
+static int sched_pid_count = 0;
+
+#define PIN_DIR_DEFAULT "/sys/fs/bpf/pingpong"
+static const char *pin_dir = PIN_DIR_DEFAULT; // bpffs directory of the pinned maps and links
+static bool pin_mode = false;         // keep programs, links and maps pinned after exit
+static bool set_filters_mode = false; // only rewrite the filters of pinned programs
+static bool unload_mode = false;      // only remove the pins
+
+static const char *output = NULL; // log file, stdout if not given
+static __u64 rotate_mib = 0;      // rotate the log at this size, 0 for no limit
+static __u64 rotate_s = 0;        // rotate the log at this age, 0 for no limit
+static int keep_files = 0;        // rotated logs to keep, 0 keeps all
+static rotate_t out;
+
+static int bench_phase_s = 0; // Seconds per overhead benchmark phase, 0 disables the benchmark
+static __u32 base_flags = 0;  // Config flags outside of the benchmark's own
+
+// Probe states the overhead benchmark cycles through
+enum bench_phase
+{
+    BENCH_ATTACHED,   // probes attached as in production
+    BENCH_SELF_TIMED, // probes attached and timing themselves into hook_stats
+    BENCH_EARLY_OUT,  // probes attached, returning right after reading the config
+    BENCH_DETACHED,  // no probes
+    BENCH_PHASES,
+};
+
+static const char *const bench_phase_names[BENCH_PHASES] = {"attached", "self_timed", "early_out", "detached"};
 
 static struct argp_option options[] = {
     {"sport", 's', "SPORT", 0, "Target source port to filter"},
@@ -27,6 +62,21 @@ static struct argp_option options[] = {
     // Note that some events may not necessarily have the port numbers set.
     // If the force filter is set, we skip events with unset port numbers.
     {"force-filter", 'f', 0, 0, "Force filtering by source and destination ports"},
+    // Scheduler probes follow pingpong-client/pingpong-server by name unless PIDs are given.
+    {"sched", 'S', 0, 0, "Trace sched_wakeup/sched_switch of the receiving threads"},
+    {"pid", 'p', "PID", 0, "Restrict scheduler probes to this process (repeatable)"},
+    // Run the client continuously meanwhile and feed both outputs to analyze_overhead.py.
+    {"overhead-bench", 'O', "SECONDS", 0, "Cycle attached/self-timed/early-out/detached probes every SECONDS"},
+    // Pinned programs stay attached between runs; later --pin runs read the same ring buffer.
+    {"pin", 'P', 0, 0, "Pin programs, links and maps and reuse them if already pinned"},
+    {"pin-dir", 'D', "DIR", 0, "bpffs directory for pinned objects (default " PIN_DIR_DEFAULT ")"},
+    {"set-filters", 'F', 0, 0, "Update the filters of the pinned programs in place and exit"},
+    {"unload", 'U', 0, 0, "Remove the pinned programs and maps and exit"},
+    // Rotated logs are renamed to FILE.<UTC time> and gzip-compressed; each starts with the topology.
+    {"output", 'o', "FILE", 0, "Write the event log to FILE instead of stdout"},
+    {"rotate-size", 'r', "MIB", 0, "Rotate the --output log once it reaches MIB mebibytes"},
+    {"rotate-time", 'R', "SECONDS", 0, "Rotate the --output log every SECONDS"},
+    {"keep", 'k', "FILES", 0, "Keep only the newest FILES rotated logs"},
     {0}};
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
@@ -62,9 +112,97 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     case 'f':
         force_filter = 1; // Enable force filtering
         break;
+    case 'S':
+        sched_enabled = true;
+        break;
+    case 'p':
+        if (arg)
+        {
+            char *end;
+            long pid = strtol(arg, &end, 10);
+            if (*end != '\0' || pid <= 0 || pid > 0x7FFFFFFF)
+            {
+                fprintf(stderr, "Invalid pid: %s\n", arg);
+                argp_usage(state);
+            }
+            if (sched_pid_count >= MAX_SCHED_PIDS)
+            {
+                fprintf(stderr, "Too many pids (max %d)\n", MAX_SCHED_PIDS);
+                argp_usage(state);
+            }
+            sched_pid_list[sched_pid_count++] = (__u32)pid;
+        }
+        break;
+    case 'O':
+        if (arg)
+        {
+            char *end;
+            long secs = strtol(arg, &end, 10);
+            if (*end != '\0' || secs <= 0 || secs > 86400)
+            {
+                fprintf(stderr, "Invalid overhead-bench period: %s\n", arg);
+                argp_usage(state);
+            }
+            bench_phase_s = (int)secs;
+        }
+        break;
+    case 'P':
+        pin_mode = true;
+        break;
+    case 'D':
+        pin_dir = arg;
+        break;
+    case 'F':
+        set_filters_mode = true;
+        break;
+    case 'U':
+        unload_mode = true;
+        break;
+    case 'o':
+        output = arg;
+        break;
+    case 'r':
+    case 'R':
+    case 'k':
+        if (arg)
+        {
+            char *end;
+            long long v = strtoll(arg, &end, 10);
+            if (*end != '\0' || v < 0 || (key == 'k' && v > 1000000))
+            {
+                fprintf(stderr, "Invalid value: %s\n", arg);
+                argp_usage(state);
+            }
+            if (key == 'r')
+            {
+                rotate_mib = v;
+            }
+            else if (key == 'R')
+            {
+                rotate_s = v;
+            }
+            else
+            {
+                keep_files = (int)v;
+            }
+        }
+        break;
     case ARGP_KEY_ARG:
         argp_usage(state);
         break;
+    case ARGP_KEY_END:
+        if (set_filters_mode + unload_mode + pin_mode > 1)
+        {
+            fprintf(stderr, "--pin, --set-filters and --unload are mutually exclusive\n");
+            argp_usage(state);
+        }
+        if (bench_phase_s && (set_filters_mode || unload_mode || pin_mode))
+        {
+            // The benchmark detaches the probes, which pinned links outlive
+            fprintf(stderr, "--overhead-bench cannot be combined with pinned programs\n");
+            argp_usage(state);
+        }
+        break;
     default:
         return ARGP_ERR_UNKNOWN;
     }
@@ -75,76 +213,267 @@ static const char *const doc = "PingPong BPF User Program - Filter events by sou
 
 static struct argp argp = {options, parse_opt, 0, doc};
 
-static int handle_event(void *ctx, void *data, size_t data_sz)
+// Direct-mapped cache of socket metadata; misses fall back to the kernel's LRU map
+#define SOCK_META_CACHE_SLOTS 1024
+static struct sock_meta sock_meta_cache[SOCK_META_CACHE_SLOTS];
+
+static struct sock_meta *sock_meta_slot(__u64 sock_id)
 {
-    const struct event *e = data;
+    // Fibonacci hashing spreads the aligned pointer values over the slots
+    return &sock_meta_cache[((sock_id * 0x9E3779B97F4A7C15ULL) >> 32) % SOCK_META_CACHE_SLOTS];
+}
+
+static const struct sock_meta *lookup_sock_meta(__u64 sock_id)
+{
+    struct sock_meta *slot = sock_meta_slot(sock_id);
+    if (slot->event_type == EVENT_TYPE_SOCK_META && slot->sock_id == sock_id)
+    {
+        return slot;
+    }
+    // The record was dropped or evicted from the cache; ask the kernel
+    if (bpf_map__lookup_elem(skel->maps.sock_meta, &sock_id, sizeof(sock_id), slot, sizeof(*slot), 0) == 0)
+    {
+        return slot;
+    }
+    return NULL;
+}
+
+static const char *event_type_str(__u8 event_type)
+{
+    switch (event_type)
+    {
+    case EVENT_TYPE_TCP_SEND:
+        return "send_entry";
+    case EVENT_TYPE_TCP_RECV:
+        return "recv_entry";
+    case EVENT_TYPE_TCP_SEND_EXIT:
+        return "send_exit";
+    case EVENT_TYPE_TCP_RECV_EXIT:
+        return "recv_exit";
+    case EVENT_TYPE_SCHED_WAKEUP:
+        return "sched_wakeup";
+    case EVENT_TYPE_SCHED_SWITCH:
+        return "sched_switch";
+    default:
+        return "unknown";
+    }
+}
 
-    if (target_sport != 0)
+static const char *event_ctx_str(__u8 ctx)
+{
+    switch (ctx)
     {
-        if (e->sport == 0 && force_filter)
+    case EVENT_CTX_PROCESS:
+        return "process";
+    case EVENT_CTX_SOFTIRQ:
+        return "softirq";
+    case EVENT_CTX_HARDIRQ:
+        return "hardirq";
+    case EVENT_CTX_NMI:
+        return "nmi";
+    default:
+        return "unknown";
+    }
+}
+
+// Read the first integer from a sysfs file, -1 if missing
+static long read_sysfs_long(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return -1;
+    }
+    long v = -1;
+    if (fscanf(f, "%ld", &v) != 1)
+    {
+        v = -1;
+    }
+    fclose(f);
+    return v;
+}
+
+// NUMA node of a CPU from its nodeN link, -1 on non-NUMA kernels
+static long cpu_node(long cpu)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld", cpu);
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        return -1;
+    }
+    long node = -1;
+    struct dirent *de;
+    while (node < 0 && (de = readdir(dir)))
+    {
+        char *end;
+        if (strncmp(de->d_name, "node", 4) == 0)
         {
-            // If sport is 0 and force_filter is set, skip this event
-            return 0;
+            long n = strtol(de->d_name + 4, &end, 10);
+            if (end != de->d_name + 4 && *end == '\0')
+            {
+                node = n;
+            }
         }
-        if (e->sport != 0 && e->sport != target_sport)
+    }
+    closedir(dir);
+    return node;
+}
+
+// Print the last-level cache and NUMA node of a CPU so the analyzer can
+// classify cross-core handoffs between events of the same log
+static void print_cpu(FILE *f, long cpu)
+{
+    char path[256];
+
+    // The highest cache level is the LLC; its id (or, on older kernels,
+    // the first CPU sharing it) identifies the cache domain
+    long llc = -1, llc_level = -1;
+    for (int idx = 0;; idx++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cache/index%d/level", cpu, idx);
+        long level = read_sysfs_long(path);
+        if (level < 0)
+        {
+            break;
+        }
+        if (level < llc_level)
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cache/index%d/id", cpu, idx);
+        long id = read_sysfs_long(path);
+        if (id < 0)
         {
-            // If sport is set and does not match target_sport, skip this event
-            return 0;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cache/index%d/shared_cpu_list", cpu, idx);
+            id = read_sysfs_long(path);
         }
+        llc_level = level;
+        llc = id;
+    }
+
+    fprintf(f, "topo cpu:%ld llc:%ld node:%ld\n", cpu, llc, cpu_node(cpu));
+}
+
+// Print the topology of every online CPU
+static void print_cpu_topology(FILE *f)
+{
+    // Online CPUs as a range list such as "0-3,8-11"
+    char list[4096];
+    FILE *online = fopen("/sys/devices/system/cpu/online", "r");
+    if (!online)
+    {
+        return;
+    }
+    if (!fgets(list, sizeof(list), online))
+    {
+        list[0] = '\0';
     }
-    if (target_dport != 0)
+    fclose(online);
+
+    char *p = list;
+    while (*p >= '0' && *p <= '9')
     {
-        if (e->dport == 0 && force_filter)
+        long first = strtol(p, &p, 10), last = first;
+        if (*p == '-')
         {
-            // If dport is 0 and force_filter is set, skip this event
-            return 0;
+            last = strtol(p + 1, &p, 10);
         }
-        if (e->dport != 0 && e->dport != target_dport)
+        for (long cpu = first; cpu <= last; cpu++)
         {
-            // If dport is set and does not match target_dport, skip this event
-            return 0;
+            print_cpu(f, cpu);
+        }
+        if (*p == ',')
+        {
+            p++;
         }
     }
+}
 
-    const char *type_str;
-    switch (e->event_type)
+// Flush a complete record and rotate the log between records
+static void log_flush(void)
+{
+    if (rotate_check(&out) < 0)
     {
-    case EVENT_TYPE_TCP_SEND:
-        type_str = "send_entry";
-        break;
-    case EVENT_TYPE_TCP_RECV:
-        type_str = "recv_entry";
-        break;
-    case EVENT_TYPE_TCP_SEND_EXIT:
-        type_str = "send_exit";
-        break;
-    case EVENT_TYPE_TCP_RECV_EXIT:
-        type_str = "recv_exit";
-        break;
-    default:
-        type_str = "unknown";
+        perror("output");
     }
+}
+
+// Open the log; the topology is its header so every rotated file can be analyzed on its own
+static int open_output(void)
+{
+    char *topo = NULL;
+    size_t topo_len = 0;
+    FILE *f = open_memstream(&topo, &topo_len);
+    if (!f)
+    {
+        return -1;
+    }
+    print_cpu_topology(f);
+    fclose(f);
+
+    int err = rotate_open(&out, output, topo, rotate_mib << 20, rotate_s, keep_files);
+    free(topo);
+    if (err)
+    {
+        return err;
+    }
+    return rotate_check(&out);
+}
+
+static int handle_event(void *ctx, void *data, size_t data_sz)
+{
+    // All records start with their type byte
+    if (*(const __u8 *)data == EVENT_TYPE_SOCK_META)
+    {
+        const struct sock_meta *meta = data;
+        *sock_meta_slot(meta->sock_id) = *meta;
+        return 0;
+    }
+
+    const struct event *e = data;
+
+    // Scheduler events carry no socket; they are already filtered by process in the kernel
+    if (e->event_type == EVENT_TYPE_SCHED_WAKEUP || e->event_type == EVENT_TYPE_SCHED_SWITCH)
+    {
+        fprintf(out.fp, "ts:%llu sock:0 pid:%u type:%s srtt:0 cpu:%u ctx:%s\n", e->timestamp_ns, e->pid,
+               event_type_str(e->event_type), e->cpu, event_ctx_str(e->ctx));
+        log_flush();
+        return 0;
+    }
+
+    // Events of sockets without metadata print "?" endpoints; ports are filtered by the hooks
+    static const struct sock_meta unknown_meta = {0};
+    const struct sock_meta *m = lookup_sock_meta(e->sock_id);
+    if (!m)
+    {
+        m = &unknown_meta;
+    }
+
+    const char *type_str = event_type_str(e->event_type);
+    const char *ctx_str = event_ctx_str(e->ctx);
 
     char src[INET6_ADDRSTRLEN] = {0}, dst[INET6_ADDRSTRLEN] = {0};
-    if (e->af == AF_INET)
+    if (m->af == AF_INET)
     {
         struct in_addr ia;
-        ia.s_addr = e->saddr.v4;
+        ia.s_addr = m->saddr.v4;
         inet_ntop(AF_INET, &ia, src, sizeof(src));
-        ia.s_addr = e->daddr.v4;
+        ia.s_addr = m->daddr.v4;
         inet_ntop(AF_INET, &ia, dst, sizeof(dst));
     }
-    else if (e->af == AF_INET6)
+    else if (m->af == AF_INET6)
     {
         struct in6_addr ia6;
         for (int i = 0; i < ADDR_V6_WORDS; i++)
         {
-            ia6.s6_addr32[i] = e->saddr.v6[i];
+            ia6.s6_addr32[i] = m->saddr.v6[i];
         }
         inet_ntop(AF_INET6, &ia6, src, sizeof(src));
         for (int i = 0; i < ADDR_V6_WORDS; i++)
         {
-            ia6.s6_addr32[i] = e->daddr.v6[i];
+            ia6.s6_addr32[i] = m->daddr.v6[i];
         }
         inet_ntop(AF_INET6, &ia6, dst, sizeof(dst));
     }
@@ -157,36 +486,316 @@ static int handle_event(void *ctx, void *data, size_t data_sz)
     // Print with direction depending on send/receive
     bool is_send = (e->event_type == EVENT_TYPE_TCP_SEND ||
                     e->event_type == EVENT_TYPE_TCP_SEND_EXIT);
-    if (e->af == AF_INET)
+    if (m->af == AF_INET)
     {
         if (is_send)
         {
-            printf("ts:%llu sock:%llu pid:%u type:%s srtt:%u %s:%u -> %s:%u\n",
-                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, src, e->sport, dst, e->dport);
+            fprintf(out.fp, "ts:%llu sock:%llu pid:%u type:%s srtt:%u cpu:%u ctx:%s %s:%u -> %s:%u\n",
+                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, e->cpu, ctx_str, src, m->sport, dst, m->dport);
         }
         else
         {
-            printf("ts:%llu sock:%llu pid:%u type:%s srtt:%u %s:%u -> %s:%u\n",
-                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, dst, e->dport, src, e->sport);
+            fprintf(out.fp, "ts:%llu sock:%llu pid:%u type:%s srtt:%u cpu:%u ctx:%s %s:%u -> %s:%u\n",
+                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, e->cpu, ctx_str, dst, m->dport, src, m->sport);
         }
     }
     else
     {
         if (is_send)
         {
-            printf("ts:%llu sock:%llu pid:%u type:%s srtt:%u [%s]:%u -> [%s]:%u\n",
-                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, src, e->sport, dst, e->dport);
+            fprintf(out.fp, "ts:%llu sock:%llu pid:%u type:%s srtt:%u cpu:%u ctx:%s [%s]:%u -> [%s]:%u\n",
+                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, e->cpu, ctx_str, src, m->sport, dst, m->dport);
         }
         else
         {
-            printf("ts:%llu sock:%llu pid:%u type:%s srtt:%u [%s]:%u -> [%s]:%u\n",
-                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, dst, e->dport, src, e->sport);
+            fprintf(out.fp, "ts:%llu sock:%llu pid:%u type:%s srtt:%u cpu:%u ctx:%s [%s]:%u -> [%s]:%u\n",
+                   e->timestamp_ns, e->sock_id, e->pid, type_str, e->srtt_us, e->cpu, ctx_str, dst, m->dport, src, m->sport);
+        }
+    }
+    log_flush();
+    return 0;
+}
+
+static int write_config(__u32 flags)
+{
+    struct pingpong_config cfg = {.flags = flags, .sport = target_sport, .dport = target_dport};
+    __u32 key = 0;
+    return bpf_map__update_elem(skel->maps.config, &key, sizeof(key), &cfg, sizeof(cfg), BPF_ANY);
+}
+
+// Replace the PID filter and the config with the ones from the command line.
+// The probes stay attached; pinned maps keep the previous run's values until now.
+static int write_filters(void)
+{
+    __u32 pid;
+    while (bpf_map__get_next_key(skel->maps.sched_pids, NULL, &pid, sizeof(pid)) == 0)
+    {
+        if (bpf_map__delete_elem(skel->maps.sched_pids, &pid, sizeof(pid), 0))
+        {
+            fprintf(stderr, "Failed to remove pid %u from filter\n", pid);
+            return -1;
+        }
+    }
+    for (int i = 0; i < sched_pid_count; i++)
+    {
+        __u8 one = 1;
+        if (bpf_map__update_elem(skel->maps.sched_pids, &sched_pid_list[i], sizeof(__u32),
+                                 &one, sizeof(one), BPF_ANY))
+        {
+            fprintf(stderr, "Failed to add pid %u to filter\n", sched_pid_list[i]);
+            return -1;
+        }
+    }
+
+    if (sched_pid_count > 0)
+    {
+        base_flags |= CONFIG_F_SCHED_PID_FILTER;
+    }
+    if (force_filter)
+    {
+        base_flags |= CONFIG_F_FORCE_PORTS;
+    }
+    if (write_config(base_flags))
+    {
+        fprintf(stderr, "Failed to write BPF config\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Path of a pinned object: maps are pinned by name, links as link_<program>
+static int pin_path(char *buf, size_t len, const char *prefix, const char *name)
+{
+    int n = snprintf(buf, len, "%s/%s%s", pin_dir, prefix, name);
+    return (n < 0 || (size_t)n >= len) ? -ENAMETOOLONG : 0;
+}
+
+static bool link_pinned(const char *prog_name)
+{
+    char path[PATH_MAX];
+    return pin_path(path, sizeof(path), "link_", prog_name) == 0 && access(path, F_OK) == 0;
+}
+
+// Whether an earlier --pin run left attached programs behind
+static bool programs_pinned(void)
+{
+    for (int i = 0; i < skel->skeleton->prog_cnt; i++)
+    {
+        if (link_pinned(skel->skeleton->progs[i].name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Let libbpf pin the maps on load, or reuse them if they are already pinned
+static int set_map_pin_paths(void)
+{
+    char path[PATH_MAX];
+    struct bpf_map *map;
+
+    bpf_object__for_each_map(map, skel->obj)
+    {
+        if (bpf_map__is_internal(map))
+        {
+            continue;
+        }
+        int err = pin_path(path, sizeof(path), "", bpf_map__name(map));
+        if (!err)
+        {
+            err = bpf_map__set_pin_path(map, path);
+        }
+        if (err)
+        {
+            return err;
+        }
+    }
+    return 0;
+}
+
+// Point the opened (not loaded) skeleton's maps at the pinned ones, so that
+// nothing is verified or allocated and the rest of the program is unchanged
+static int reuse_pinned_maps(void)
+{
+    char path[PATH_MAX];
+    struct bpf_map *map;
+
+    bpf_object__for_each_map(map, skel->obj)
+    {
+        if (bpf_map__is_internal(map))
+        {
+            continue;
+        }
+        int err = pin_path(path, sizeof(path), "", bpf_map__name(map));
+        if (err)
+        {
+            return err;
+        }
+        int fd = bpf_obj_get(path);
+        if (fd < 0)
+        {
+            err = -errno;
+            fprintf(stderr, "Failed to open pinned map %s: %s\n", path, strerror(errno));
+            return err;
+        }
+        err = bpf_map__reuse_fd(map, fd);
+        close(fd);
+        if (err)
+        {
+            fprintf(stderr, "Failed to reuse pinned map %s: %d\n", path, err);
+            return err;
         }
     }
-    fflush(stdout);
     return 0;
 }
 
+// Pin the attached links so the programs outlive this process
+static int pin_links(void)
+{
+    char path[PATH_MAX];
+
+    for (int i = 0; i < skel->skeleton->prog_cnt; i++)
+    {
+        struct bpf_link *link = *skel->skeleton->progs[i].link;
+        if (!link)
+        {
+            continue;
+        }
+        int err = pin_path(path, sizeof(path), "link_", skel->skeleton->progs[i].name);
+        if (!err)
+        {
+            err = bpf_link__pin(link, path);
+        }
+        if (err)
+        {
+            fprintf(stderr, "Failed to pin link %s: %d\n", path, err);
+            return err;
+        }
+    }
+    return 0;
+}
+
+// Remove all pins; each program detaches once no process holds its link
+static int unload_pinned(void)
+{
+    char path[PATH_MAX];
+    struct bpf_map *map;
+    int err = 0;
+
+    for (int i = 0; i < skel->skeleton->prog_cnt; i++)
+    {
+        if (pin_path(path, sizeof(path), "link_", skel->skeleton->progs[i].name) == 0 &&
+            unlink(path) && errno != ENOENT)
+        {
+            fprintf(stderr, "Failed to remove %s: %s\n", path, strerror(errno));
+            err = -errno;
+        }
+    }
+    bpf_object__for_each_map(map, skel->obj)
+    {
+        if (!bpf_map__is_internal(map) &&
+            pin_path(path, sizeof(path), "", bpf_map__name(map)) == 0 &&
+            unlink(path) && errno != ENOENT)
+        {
+            fprintf(stderr, "Failed to remove %s: %s\n", path, strerror(errno));
+            err = -errno;
+        }
+    }
+    if (rmdir(pin_dir) && errno != ENOENT)
+    {
+        fprintf(stderr, "Failed to remove %s: %s\n", pin_dir, strerror(errno));
+        err = -errno;
+    }
+    return err;
+}
+
+static __u64 clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool probes_attached = false;
+
+// Switch the probes into the given benchmark phase and log a marker line.
+// ts is CLOCK_MONOTONIC like event timestamps; ts_real_us lines up with client CSVs.
+static int enter_bench_phase(enum bench_phase phase)
+{
+    int err = 0;
+
+    if (phase == BENCH_DETACHED)
+    {
+        pingpong_kern_bpf__detach(skel);
+        probes_attached = false;
+    }
+    else
+    {
+        // Set the flags before attaching so no hook runs in the wrong mode
+        __u32 phase_flags[BENCH_PHASES] = {
+            [BENCH_SELF_TIMED] = CONFIG_F_SELF_TIME,
+            [BENCH_EARLY_OUT] = CONFIG_F_EARLY_OUT,
+        };
+        err = write_config(base_flags | phase_flags[phase]);
+        if (!err && !probes_attached)
+        {
+            err = pingpong_kern_bpf__attach(skel);
+            probes_attached = !err;
+        }
+    }
+    if (err)
+    {
+        fprintf(stderr, "Failed to enter benchmark phase %s: %d\n", bench_phase_names[phase], err);
+        return err;
+    }
+
+    fprintf(out.fp, "phase:%s ts:%llu ts_real_us:%llu\n", bench_phase_names[phase],
+           clock_ns(CLOCK_MONOTONIC), clock_ns(CLOCK_REALTIME) / 1000);
+    log_flush();
+    return 0;
+}
+
+// Print the self-timed hook histograms summed over all CPUs
+static void print_hook_stats(void)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    if (ncpus <= 0)
+    {
+        return;
+    }
+    __u64 *values = calloc(ncpus, sizeof(__u64));
+    if (!values)
+    {
+        return;
+    }
+
+    for (__u32 hook = 0; hook < HOOK_COUNT; hook++)
+    {
+        for (__u32 bucket = 0; bucket < HOOK_STAT_BUCKETS; bucket++)
+        {
+            __u32 idx = hook * HOOK_STAT_BUCKETS + bucket;
+            if (bpf_map__lookup_elem(skel->maps.hook_stats, &idx, sizeof(idx),
+                                     values, ncpus * sizeof(__u64), 0))
+            {
+                continue;
+            }
+            __u64 count = 0;
+            for (int cpu = 0; cpu < ncpus; cpu++)
+            {
+                count += values[cpu];
+            }
+            if (count)
+            {
+                fprintf(out.fp, "overhead hook:%s bucket_ns:%llu count:%llu\n",
+                       event_type_str(hook + 1), 1ULL << bucket, count);
+            }
+        }
+    }
+    log_flush();
+    free(values);
+}
+
 static void cleanup(void)
 {
     int rb_cleanup = 0, skel_cleanup = 0;
@@ -210,6 +819,10 @@ static void cleanup(void)
     {
         fprintf(stderr, "[INFO] BPF skeleton cleaned up\n");
     }
+    if (out.fp)
+    {
+        rotate_close(&out);
+    }
 }
 
 static void fatal_handler(int sig)
@@ -249,21 +862,102 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    // Open, load, and verify BPF application
-    skel = pingpong_kern_bpf__open_and_load();
+    // Open BPF application
+    skel = pingpong_kern_bpf__open();
     if (!skel)
     {
-        fprintf(stderr, "Failed to open and load BPF skeleton\n");
+        fprintf(stderr, "Failed to open BPF skeleton\n");
         return 1;
     }
 
-    // Attach tracepoints or kprobes
-    err = pingpong_kern_bpf__attach(skel);
+    // sched_switch fires on every context switch; only load the probes on request
+    if (!sched_enabled)
+    {
+        bpf_program__set_autoload(skel->progs.handle_sched_wakeup, false);
+        bpf_program__set_autoload(skel->progs.handle_sched_switch, false);
+    }
+
+    if (unload_mode)
+    {
+        err = unload_pinned();
+        if (!err)
+        {
+            fprintf(stderr, "[INFO] Pinned programs under %s removed\n", pin_dir);
+        }
+        goto cleanup;
+    }
+
+    // Attach to programs pinned by an earlier --pin run instead of reloading them
+    bool reuse = set_filters_mode || (pin_mode && programs_pinned());
+    if (reuse)
+    {
+        err = reuse_pinned_maps();
+        if (err)
+        {
+            fprintf(stderr, "No pinned programs under %s; start with --pin first\n", pin_dir);
+            goto cleanup;
+        }
+        if (!set_filters_mode && sched_enabled != link_pinned("handle_sched_wakeup"))
+        {
+            fprintf(stderr, "[WARN] Pinned programs were loaded %s scheduler probes; "
+                            "--unload and restart to change that\n",
+                    sched_enabled ? "without" : "with");
+        }
+    }
+    else
+    {
+        if (pin_mode)
+        {
+            err = set_map_pin_paths();
+            if (err)
+            {
+                fprintf(stderr, "Failed to set pin paths under %s\n", pin_dir);
+                goto cleanup;
+            }
+        }
+
+        // Load and verify BPF application
+        err = pingpong_kern_bpf__load(skel);
+        if (err)
+        {
+            fprintf(stderr, "Failed to load BPF skeleton\n");
+            goto cleanup;
+        }
+    }
+
+    // Populate the config and PID filter before any probe is attached
+    err = write_filters();
     if (err)
     {
-        fprintf(stderr, "Failed to attach BPF skeleton\n");
         goto cleanup;
     }
+    if (set_filters_mode)
+    {
+        fprintf(stderr, "[INFO] Filters of the pinned programs updated\n");
+        goto cleanup;
+    }
+
+    if (!reuse)
+    {
+        // Attach tracepoints or kprobes
+        err = pingpong_kern_bpf__attach(skel);
+        if (err)
+        {
+            fprintf(stderr, "Failed to attach BPF skeleton\n");
+            goto cleanup;
+        }
+        probes_attached = true;
+
+        if (pin_mode)
+        {
+            err = pin_links();
+            if (err)
+            {
+                goto cleanup;
+            }
+            fprintf(stderr, "[INFO] Programs pinned under %s; remove them with --unload\n", pin_dir);
+        }
+    }
 
     // Set up ring buffer polling
     rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, NULL, NULL);
@@ -274,11 +968,41 @@ int main(int argc, char **argv)
         goto cleanup;
     }
 
+    err = open_output();
+    if (err)
+    {
+        fprintf(stderr, "Failed to open output %s: %s\n", output ? output : "stdout", strerror(errno));
+        goto cleanup;
+    }
+
     fprintf(stderr, "Successfully started! Please run `sudo cat /sys/kernel/debug/tracing/trace_pipe` "
                     "to see output of the BPF programs.\n");
 
+    enum bench_phase phase = BENCH_ATTACHED;
+    __u64 next_phase_ns = 0;
+    if (bench_phase_s)
+    {
+        err = enter_bench_phase(phase);
+        if (err)
+        {
+            goto cleanup;
+        }
+        next_phase_ns = clock_ns(CLOCK_MONOTONIC) + (__u64)bench_phase_s * 1000000000ULL;
+    }
+
     while (!exiting)
     {
+        if (bench_phase_s && clock_ns(CLOCK_MONOTONIC) >= next_phase_ns)
+        {
+            phase = (phase + 1) % BENCH_PHASES;
+            err = enter_bench_phase(phase);
+            if (err)
+            {
+                break;
+            }
+            next_phase_ns += (__u64)bench_phase_s * 1000000000ULL;
+        }
+
         err = ring_buffer__poll(rb, 100 /* timeout, ms */);
         // Ctrl-C will cause -EINTR
         if (err == -EINTR)
@@ -293,6 +1017,13 @@ int main(int argc, char **argv)
         }
     }
 
+    if (bench_phase_s)
+    {
+        // Drain events of the last phase before the histograms
+        ring_buffer__consume(rb);
+        print_hook_stats();
+    }
+
 cleanup:
     cleanup();
     return -err;
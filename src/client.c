@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -5,11 +7,50 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <time.h>
 #include <getopt.h>
 
 #include "common.h"
+#include "rotate.h"
+#include "soak.h"
+#include "uring.h"
+
+// How long to wait for TX stamps after the pong has already arrived
+#define TS_TX_TIMEOUT_MS 10
+
+#define CLIENT_CSV_HEADER "seq,send_entry_us,send_exit_us,recv_entry_us,syscalls\n"
+
+#define USAGE "Usage: %s -a <address> -P <control_port> [-e <exp_port>] -s <bytes> (-c <number> | -d <seconds>) " \
+              "-o <file> [-t] [-i blocking|uring] [-q] [-w <seconds>] [-T <us>] [-r <MiB>] [-R <seconds>] [-k <files>]\n"
+
+static int io_backend = IO_BACKEND_BLOCKING;
+static uring_conn_t uring;
+
+static int client_send(int sockfd, const char *buf, int size)
+{
+    if (io_backend == IO_BACKEND_URING)
+        return uring_conn_send(&uring);
+    return send_all(sockfd, buf, size);
+}
+
+static int client_recv(int sockfd, char *buf, int size)
+{
+    if (io_backend == IO_BACKEND_URING)
+        return uring_conn_recv(&uring);
+    return recv_all(sockfd, buf, size);
+}
+
+// syscalls made by the experiment I/O path so far
+static uint64_t client_syscalls(void)
+{
+    if (io_backend == IO_BACKEND_URING)
+        return uring_conn_syscalls(&uring);
+    return io_syscalls;
+}
 
 // get current time in microseconds
 uint64_t time_us()
@@ -19,14 +60,177 @@ uint64_t time_us()
     return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
+// Ping-pong loop that derives the stack breakdown from SO_TIMESTAMPING stamps
+// instead of eBPF probes. Columns match those of analyze_ebpf.py.
+// Returns the number of completed iterations.
+static uint64_t run_timestamped(int sockfd, char *buf, int size, uint32_t count, FILE *fp)
+{
+    fprintf(fp, "seq,send_stack_us,recv_stack_us,network_latency_us,nic_rtt_us\n");
+
+    uint32_t sent = 0; // bytes sent since timestamping was enabled (wraps like OPT_ID)
+    uint64_t done = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ts_sample_t tx, rx;
+        uint64_t send_ns = realtime_ns();
+        if (send_all(sockfd, buf, size) < 0)
+        {
+            perror("send");
+            break;
+        }
+        sent += size;
+        if (recv_all_ts(sockfd, buf, size, &rx) < 0)
+        {
+            perror("recv");
+            break;
+        }
+        uint64_t recv_ns = realtime_ns();
+
+        // Everything below runs after the pong arrived, outside the measured path
+        int have_tx = ts_collect_tx(sockfd, sent - 1, &tx, TS_TX_TIMEOUT_MS) == 0;
+        uint64_t tx_ns = tx.sw_ns ? tx.sw_ns : tx.sched_ns;
+        struct tcp_info ti;
+        socklen_t ti_len = sizeof(ti);
+        if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &ti, &ti_len) < 0)
+            ti.tcpi_rtt = 0;
+
+        // Missing stamps leave the column empty rather than guessing
+        fprintf(fp, "%u,", i);
+        if (have_tx && tx_ns)
+            fprintf(fp, "%.3f", (double)(int64_t)(tx_ns - send_ns) / 1000.0);
+        fprintf(fp, ",");
+        if (rx.sw_ns)
+            fprintf(fp, "%.3f", (double)(int64_t)(recv_ns - rx.sw_ns) / 1000.0);
+        fprintf(fp, ",%u,", ti.tcpi_rtt);
+        if (tx.hw_ns && rx.hw_ns)
+            fprintf(fp, "%.3f", (double)(int64_t)(rx.hw_ns - tx.hw_ns) / 1000.0);
+        fprintf(fp, "\n");
+        done++;
+    }
+    return done;
+}
+
+// CLOCK_MONOTONIC in microseconds; unlike time_us() it never steps
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Parse an unsigned decimal option value up to max; -1 on anything else
+static int parse_u64(const char *arg, uint64_t max, uint64_t *out)
+{
+    char *end;
+    if (*arg < '0' || *arg > '9')
+        return -1; // strtoull would accept and negate "-1"
+    errno = 0;
+    unsigned long long v = strtoull(arg, &end, 10);
+    if (errno || *end != '\0' || v > max)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+// Upper bound for second-valued options, keeping their microseconds in range
+#define MAX_SECONDS (10ULL * 365 * 86400)
+
+static volatile sig_atomic_t soak_stop = 0;
+
+static void soak_sig_handler(int sig)
+{
+    soak_stop = 1;
+}
+
+// Write a finished window and rotate the outputs between records
+static void soak_flush(soak_window_t *w, rotate_t *summary, rotate_t *raw, uint64_t tail_threshold_us)
+{
+    soak_window_write(w, summary->fp, raw ? raw->fp : NULL, tail_threshold_us);
+    if (rotate_check(summary) < 0)
+        perror("summary output");
+    if (raw && rotate_check(raw) < 0)
+        perror("raw output");
+}
+
+// Soak loop: runs for duration_s and keeps one histogram/summary row per
+// window instead of a row per iteration, so memory and disk use stay bounded.
+// Raw rows are written only for windows whose p99 exceeds tail_threshold_us.
+// Returns the number of iterations.
+static uint64_t run_soak(int sockfd, char *buf, int size, uint64_t duration_s, uint64_t window_s,
+                         uint64_t tail_threshold_us, rotate_t *summary, rotate_t *raw)
+{
+    // Days-long runs see NTP steps, so the schedule and the RTTs use the
+    // monotonic clock. Realtime only labels the samples: each window maps
+    // monotonic to realtime with one offset taken when it starts.
+    soak_window_t w = {0};
+    uint64_t window_us = window_s * 1000000;
+    uint64_t start = monotonic_us();
+    uint64_t end = start + duration_s * 1000000;
+    uint64_t window_start = start;
+    uint64_t real_offset = time_us() - start;
+    uint64_t iters = 0;
+
+    // Finish the current window and stop on Ctrl-C instead of losing it
+    signal(SIGINT, soak_sig_handler);
+    signal(SIGTERM, soak_sig_handler);
+
+    soak_window_reset(&w, window_start + real_offset);
+    while (!soak_stop)
+    {
+        // Window bookkeeping happens before the iteration's first timestamp
+        uint64_t now = monotonic_us();
+        if (now >= end)
+            break;
+        if (now >= window_start + window_us)
+        {
+            soak_flush(&w, summary, raw, tail_threshold_us);
+            // Windows without samples (e.g. during a stall) are skipped
+            window_start = now - (now - start) % window_us;
+            real_offset = time_us() - monotonic_us();
+            soak_window_reset(&w, window_start + real_offset);
+        }
+
+        soak_sample_t s;
+        s.seq = iters;
+        s.syscalls = client_syscalls();
+        s.send_entry_us = monotonic_us() + real_offset;
+        if (client_send(sockfd, buf, size) < 0)
+        {
+            perror("send");
+            break;
+        }
+        s.send_exit_us = monotonic_us() + real_offset;
+        if (client_recv(sockfd, buf, size) < 0)
+        {
+            perror("recv");
+            break;
+        }
+        s.recv_entry_us = monotonic_us() + real_offset;
+        s.syscalls = client_syscalls() - s.syscalls;
+        soak_window_add(&w, &s, raw != NULL);
+        iters++;
+    }
+    soak_flush(&w, summary, raw, tail_threshold_us);
+    soak_window_free(&w);
+    return iters;
+}
+
 int main(int argc, char *argv[])
 {
     char *ctrl_addr = NULL;
     int ctrl_port = 0;
     int exp_port = 0;
     int size = 0;
-    int count = 0;
+    uint32_t count = 0;
     char *output = NULL;
+    int timestamping = 0;
+    int sqpoll = 0;
+    uint64_t duration_s = 0;        // soak mode when set
+    uint64_t window_s = 10;         // soak aggregation window
+    uint64_t tail_threshold_us = 0; // keep raw rows of windows with a slower p99, 0 for none
+    uint64_t rotate_mib = 0;
+    uint64_t rotate_s = 0;
+    uint64_t keep = 0; // rotated raw files to keep; summaries are never pruned
 
     static struct option long_options[] = {
         {"addr", required_argument, 0, 'a'},
@@ -35,11 +239,21 @@ int main(int argc, char *argv[])
         {"size", required_argument, 0, 's'},
         {"count", required_argument, 0, 'c'},
         {"output", required_argument, 0, 'o'},
+        {"timestamping", no_argument, 0, 't'},
+        {"io", required_argument, 0, 'i'},
+        {"sqpoll", no_argument, 0, 'q'},
+        {"duration", required_argument, 0, 'd'},
+        {"window", required_argument, 0, 'w'},
+        {"tail-threshold-us", required_argument, 0, 'T'},
+        {"rotate-size", required_argument, 0, 'r'},
+        {"rotate-time", required_argument, 0, 'R'},
+        {"keep", required_argument, 0, 'k'},
         {0, 0, 0, 0}};
 
     int opt;
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "a:P:e:s:c:o:", long_options, &option_index)) != -1)
+    uint64_t v;
+    while ((opt = getopt_long(argc, argv, "a:P:e:s:c:o:ti:qd:w:T:r:R:k:", long_options, &option_index)) != -1)
     {
         switch (opt)
         {
@@ -56,24 +270,86 @@ int main(int argc, char *argv[])
             size = atoi(optarg);
             break;
         case 'c':
-            count = atoi(optarg);
+            if (parse_u64(optarg, UINT32_MAX, &v) < 0 || v == 0)
+            {
+                fprintf(stderr, "Invalid count: %s\n", optarg);
+                fprintf(stderr, USAGE, argv[0]);
+                return EXIT_FAILURE;
+            }
+            count = v; // the negotiation carries 32 bits
             break;
         case 'o':
             output = optarg;
             break;
+        case 't':
+            timestamping = 1;
+            break;
+        case 'i':
+            io_backend = parse_io_backend(optarg);
+            if (io_backend < 0)
+            {
+                fprintf(stderr, "Unknown I/O backend: %s (expected blocking or uring)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            sqpoll = 1;
+            break;
+        case 'd':
+        case 'w':
+        case 'T':
+        case 'r':
+        case 'R':
+        case 'k':
+        {
+            // MiB are shifted to bytes; keep sizes the ring of rotated names
+            uint64_t max = opt == 'r' ? (1ULL << 40) : opt == 'k' ? 1000000 : opt == 'T' ? UINT32_MAX : MAX_SECONDS;
+            if (parse_u64(optarg, max, &v) < 0)
+            {
+                fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+                fprintf(stderr, USAGE, argv[0]);
+                return EXIT_FAILURE;
+            }
+            if (opt == 'd')
+                duration_s = v;
+            else if (opt == 'w')
+                window_s = v;
+            else if (opt == 'T')
+                tail_threshold_us = v;
+            else if (opt == 'r')
+                rotate_mib = v;
+            else if (opt == 'R')
+                rotate_s = v;
+            else
+                keep = v;
+            break;
+        }
         default:
-            fprintf(stderr, "Usage: %s -a <address> -P <control_port> [-e <exp_port>] -s <bytes> -c <number> -o <file>\n", argv[0]);
+            fprintf(stderr, USAGE, argv[0]);
             return EXIT_FAILURE;
         }
     }
 
-    if (!ctrl_addr || ctrl_port <= 0 || size <= 0 || count <= 0 || !output)
+    // Exactly one of --count and --duration bounds the run
+    if (!ctrl_addr || ctrl_port <= 0 || size <= 0 || (count == 0) == (duration_s == 0) || !output ||
+        window_s == 0)
     {
-        fprintf(stderr, "Usage: %s -a <address> -P <control_port> [-e <exp_port>] -s <bytes> -c <number> -o <file>\n", argv[0]);
+        fprintf(stderr, USAGE, argv[0]);
         return EXIT_FAILURE;
     }
     if (exp_port <= 0)
         exp_port = ctrl_port + 1;
+    // Timestamps arrive as cmsgs and on the error queue of blocking recvmsg calls
+    if (timestamping && io_backend != IO_BACKEND_BLOCKING)
+    {
+        fprintf(stderr, "--timestamping requires the blocking I/O backend\n");
+        return EXIT_FAILURE;
+    }
+    if (timestamping && duration_s)
+    {
+        fprintf(stderr, "--duration is not supported with --timestamping\n");
+        return EXIT_FAILURE;
+    }
 
     // Negotiate on control channel
     int ctrl_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -99,8 +375,11 @@ int main(int argc, char *argv[])
     }
 
     negotiation_t neg_net;
+    memset(&neg_net, 0, sizeof(neg_net));
+    neg_net.magic = NEG_MAGIC;
+    neg_net.flags = timestamping ? NEG_FLAG_TIMESTAMPING : 0;
     neg_net.size = htonl(size);
-    neg_net.count = htonl(count);
+    neg_net.count = htonl(count); // 0: the server echoes until the connection closes
     neg_net.exp_port = htons(exp_port);
     if (send_all(ctrl_fd, &neg_net, sizeof(neg_net)) < 0)
     {
@@ -116,6 +395,7 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
     close(ctrl_fd);
+    io_syscalls = 0; // count only the experiment connection
     uint32_t status = ntohl(status_net);
     if (status != NEG_STATUS_OK)
     {
@@ -157,14 +437,38 @@ int main(int argc, char *argv[])
         perror("connect experiment");
         return EXIT_FAILURE;
     }
-
-    FILE *fp = fopen(output, "w");
-    if (!fp)
+    // Unprivileged kernel timestamps; OPT_ID keys count bytes from here on (TCP needs a connected socket)
+    if (timestamping && ts_enable(sockfd) < 0)
     {
-        perror("fopen");
+        perror("setsockopt SO_TIMESTAMPING");
         return EXIT_FAILURE;
     }
-    fprintf(fp, "seq,send_entry_us,send_exit_us,recv_entry_us\n");
+
+    // Soak runs write a rotated summary and, for slow windows, rotated raw rows next to it
+    FILE *fp = NULL;
+    rotate_t summary, raw;
+    int have_raw = duration_s && tail_threshold_us;
+    if (duration_s)
+    {
+        char raw_path[4096];
+        snprintf(raw_path, sizeof(raw_path), "%s.raw", output);
+        // Summaries are ~1 KB per window and cover the whole run, so only raw files are pruned
+        if (rotate_open(&summary, output, SOAK_SUMMARY_HEADER, rotate_mib << 20, rotate_s, 0) < 0 ||
+            (have_raw && rotate_open(&raw, raw_path, CLIENT_CSV_HEADER, rotate_mib << 20, rotate_s, (int)keep) < 0))
+        {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        fp = fopen(output, "w");
+        if (!fp)
+        {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+    }
 
     char *buf = malloc(size);
     if (!buf)
@@ -174,25 +478,62 @@ int main(int argc, char *argv[])
     }
     memset(buf, 'P', size);
 
-    for (int i = 0; i < count; i++)
+    if (io_backend == IO_BACKEND_URING && uring_conn_init(&uring, sockfd, buf, size, sqpoll) < 0)
     {
-        uint64_t ts1 = time_us();
-        if (send_all(sockfd, buf, size) < 0)
-        {
-            perror("send");
-            break;
-        }
-        uint64_t ts2 = time_us();
-        if (recv_all(sockfd, buf, size) < 0)
+        perror("io_uring setup");
+        return EXIT_FAILURE;
+    }
+
+    // Completed iterations; early exits on errors or EOF must not skew the per-iteration figure
+    uint64_t iters = 0;
+    if (duration_s)
+    {
+        iters = run_soak(sockfd, buf, size, duration_s, window_s, tail_threshold_us,
+                         &summary, have_raw ? &raw : NULL);
+    }
+    else if (timestamping)
+    {
+        iters = run_timestamped(sockfd, buf, size, count, fp);
+    }
+    else
+    {
+        fprintf(fp, CLIENT_CSV_HEADER);
+        for (uint32_t i = 0; i < count; i++)
         {
-            perror("recv");
-            break;
+            uint64_t calls = client_syscalls();
+            uint64_t ts1 = time_us();
+            if (client_send(sockfd, buf, size) < 0)
+            {
+                perror("send");
+                break;
+            }
+            uint64_t ts2 = time_us();
+            if (client_recv(sockfd, buf, size) < 0)
+            {
+                perror("recv");
+                break;
+            }
+            uint64_t ts3 = time_us();
+            fprintf(fp, "%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                    i, ts1, ts2, ts3, client_syscalls() - calls);
+            iters++;
         }
-        uint64_t ts3 = time_us();
-        fprintf(fp, "%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", i, ts1, ts2, ts3);
     }
+    fprintf(stderr, "I/O syscalls: %" PRIu64 " (%.2f per iteration)\n",
+            client_syscalls(), iters > 0 ? (double)client_syscalls() / iters : 0.0);
 
-    fclose(fp);
+    if (duration_s)
+    {
+        rotate_close(&summary);
+        if (have_raw)
+            rotate_close(&raw);
+    }
+    else
+    {
+        fclose(fp);
+    }
+    if (io_backend == IO_BACKEND_URING)
+        uring_conn_close(&uring);
     free(buf);
     close(sockfd);
     return EXIT_SUCCESS;
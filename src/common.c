@@ -1,5 +1,35 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
 #include "common.h"
 
+uint64_t io_syscalls = 0;
+
+// Set once a hardware TX stamp was seen, i.e. the NIC stamps transmits. RX
+// hardware stamps alone do not count: with tx_type OFF no TX stamp ever comes.
+static int ts_hw_seen = 0;
+
+static int64_t elapsed_ms(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+int parse_io_backend(const char *name)
+{
+    if (strcmp(name, "blocking") == 0)
+        return IO_BACKEND_BLOCKING;
+    if (strcmp(name, "uring") == 0)
+        return IO_BACKEND_URING;
+    return -1;
+}
+
 int send_all(int sockfd, const void *buf, size_t len)
 {
     size_t total = 0;
@@ -7,6 +37,7 @@ int send_all(int sockfd, const void *buf, size_t len)
     while (total < len)
     {
         ssize_t n = send(sockfd, p + total, len - total, 0);
+        io_syscalls++;
         if (n <= 0)
             return -1;
         total += n;
@@ -21,9 +52,132 @@ int recv_all(int sockfd, void *buf, size_t len)
     while (total < len)
     {
         ssize_t n = recv(sockfd, p + total, len - total, 0);
+        io_syscalls++;
+        if (n <= 0)
+            return -1;
+        total += n;
+    }
+    return 0;
+}
+
+uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t timespec_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+int ts_enable(int sockfd)
+{
+    int flags = SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE |
+                SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE |
+                SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_TX_SWHW |
+                SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    return setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+int recv_all_ts(int sockfd, void *buf, size_t len, ts_sample_t *rx)
+{
+    size_t total = 0;
+    char *p = buf;
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+
+    memset(rx, 0, sizeof(*rx));
+    while (total < len)
+    {
+        struct iovec iov = {.iov_base = p + total, .iov_len = len - total};
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        ssize_t n = recvmsg(sockfd, &msg, 0);
+        io_syscalls++;
         if (n <= 0)
             return -1;
         total += n;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPING)
+                continue;
+            const struct scm_timestamping *tss = (const void *)CMSG_DATA(cm);
+            if (tss->ts[0].tv_sec || tss->ts[0].tv_nsec)
+                rx->sw_ns = timespec_ns(&tss->ts[0]);
+            if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec)
+                rx->hw_ns = timespec_ns(&tss->ts[2]);
+        }
     }
     return 0;
 }
+
+int ts_collect_tx(int sockfd, uint32_t id, ts_sample_t *tx, int timeout_ms)
+{
+    char control[CMSG_SPACE(sizeof(struct scm_timestamping)) +
+                 CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(tx, 0, sizeof(*tx));
+    for (;;)
+    {
+        struct msghdr msg = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        ssize_t n = recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+            // The software SND stamp comes first; with OPT_TX_SWHW the hardware
+            // one is queued separately on TX completion, so wait for it as well
+            if (tx->sw_ns && (tx->hw_ns || !ts_hw_seen))
+                return 0;
+            int64_t left = timeout_ms - elapsed_ms(&start);
+            struct pollfd pfd = {.fd = sockfd, .events = 0};
+            if (left <= 0 || poll(&pfd, 1, (int)left) <= 0)
+                return tx->sched_ns || tx->sw_ns || tx->hw_ns ? 0 : -1;
+            continue;
+        }
+
+        // Each message carries one scm_timestamping followed by its sock_extended_err
+        const struct scm_timestamping *tss = NULL;
+        const struct sock_extended_err *serr = NULL;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+                tss = (const void *)CMSG_DATA(cm);
+            else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                     (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+                serr = (const void *)CMSG_DATA(cm);
+        }
+        if (!tss || !serr || serr->ee_errno != ENOMSG || serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+            continue;
+        // A late hardware stamp of an earlier send still shows the NIC stamps transmits
+        if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec)
+            ts_hw_seen = 1;
+        if (serr->ee_data != id)
+            continue; // stamp of an earlier send
+
+        switch (serr->ee_info)
+        {
+        case SCM_TSTAMP_SCHED:
+            tx->sched_ns = timespec_ns(&tss->ts[0]);
+            break;
+        case SCM_TSTAMP_SND:
+            if (tss->ts[0].tv_sec || tss->ts[0].tv_nsec)
+                tx->sw_ns = timespec_ns(&tss->ts[0]);
+            if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec)
+                tx->hw_ns = timespec_ns(&tss->ts[2]);
+            break;
+        }
+    }
+}
@@ -13,6 +13,49 @@ int send_all(int sockfd, const void *buf, size_t len);
 // recv_all ensures all data is received
 int recv_all(int sockfd, void *buf, size_t len);
 
+// send/recv syscalls made by the helpers above, for per-iteration accounting
+extern uint64_t io_syscalls;
+
+// I/O backends selectable at runtime with --io
+enum io_backend
+{
+    IO_BACKEND_BLOCKING = 0, // send_all/recv_all, one syscall per partial transfer
+    IO_BACKEND_URING = 1,    // io_uring, see uring.h
+};
+
+// parse_io_backend maps "blocking"/"uring" to an io_backend, -1 if unknown
+int parse_io_backend(const char *name);
+
+// Kernel timestamps for one message, in nanoseconds. Software stamps use
+// CLOCK_REALTIME; hardware stamps use the NIC clock and are 0 if unavailable.
+typedef struct ts_sample
+{
+    uint64_t sched_ns; // TX: data entered the packet scheduler
+    uint64_t sw_ns;    // TX: passed to the driver; RX: entered the stack
+    uint64_t hw_ns;    // TX/RX: NIC hardware stamp
+} ts_sample_t;
+
+// realtime_ns returns CLOCK_REALTIME, the clock of software socket timestamps
+uint64_t realtime_ns(void);
+
+// ts_enable turns on SO_TIMESTAMPING (software, plus hardware where the NIC
+// is configured for it) with per-byte OPT_ID keys. Call before any payload is sent.
+int ts_enable(int sockfd);
+
+// recv_all_ts is recv_all that also reports the RX stamp of the last segment read
+int recv_all_ts(int sockfd, void *buf, size_t len, ts_sample_t *rx);
+
+// ts_collect_tx drains the error queue until the TX stamps of the send whose
+// last byte has OPT_ID key `id` are found, waiting at most timeout_ms in total.
+// Once a hardware TX stamp has been seen it also waits for the hardware TX stamp.
+int ts_collect_tx(int sockfd, uint32_t id, ts_sample_t *tx, int timeout_ms);
+
+// Negotiation flags. Older clients left the bytes after exp_port uninitialized,
+// so the server honours flags only with NEG_MAGIC and no unknown bit set.
+#define NEG_MAGIC 0xA5
+#define NEG_FLAG_TIMESTAMPING (1U << 0) // server records SO_TIMESTAMPING breakdown
+#define NEG_FLAGS_KNOWN NEG_FLAG_TIMESTAMPING
+
 // Negotiation status codes used between client and server
 enum neg_status
 {
@@ -29,6 +72,8 @@ typedef struct negotiation
     uint32_t size;     // payload size per message (network order)
     uint32_t count;    // number of exchanges (network order)
     uint16_t exp_port; // experiment port (network order)
+    uint8_t magic;     // NEG_MAGIC if flags is valid
+    uint8_t flags;     // NEG_FLAG_*
 } negotiation_t;
 
 #endif // PINGPONG_COMMON_H
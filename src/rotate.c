@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "rotate.h"
+
+extern char **environ;
+
+static uint64_t monotonic_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec;
+}
+
+// Failed rotations (e.g. a full disk) are retried after this many seconds
+#define ROTATE_RETRY_S 10
+
+// Open a fresh file at path; r is only changed on success
+static int open_current(rotate_t *r)
+{
+    FILE *fp = fopen(r->path, "w");
+    if (!fp)
+        return -1;
+    r->fp = fp;
+    r->opened_s = monotonic_s();
+    if (r->header)
+        fputs(r->header, r->fp);
+    return 0;
+}
+
+int rotate_open(rotate_t *r, const char *path, const char *header,
+                uint64_t max_bytes, uint64_t max_age_s, int keep)
+{
+    memset(r, 0, sizeof(*r));
+    r->max_bytes = max_bytes;
+    r->max_age_s = max_age_s;
+    r->keep = keep;
+    if (header && !(r->header = strdup(header)))
+        return -1;
+    if (!path)
+    {
+        r->fp = stdout;
+        if (r->header)
+            fputs(r->header, r->fp);
+        return 0;
+    }
+    if (!(r->path = strdup(path)))
+        return -1;
+    if (keep > 0 && !(r->rotated = calloc(keep, sizeof(char *))))
+        return -1;
+    return open_current(r);
+}
+
+static void wait_gzip(rotate_t *r)
+{
+    if (r->gzip_pid > 0)
+    {
+        int status;
+        while (waitpid(r->gzip_pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        r->gzip_pid = 0;
+    }
+}
+
+static int rotated_exists(const char *name)
+{
+    char gz[PATH_MAX + sizeof(".gz")];
+    snprintf(gz, sizeof(gz), "%s.gz", name);
+    return access(name, F_OK) == 0 || access(gz, F_OK) == 0;
+}
+
+// Remove a rotated file whether or not its compression has finished
+static void remove_rotated(const char *name)
+{
+    char gz[PATH_MAX + sizeof(".gz")];
+    snprintf(gz, sizeof(gz), "%s.gz", name);
+    unlink(gz);
+    unlink(name);
+}
+
+// Remember a rotated file and drop the oldest one beyond `keep`
+static void track_rotated(rotate_t *r, char *name)
+{
+    if (r->keep <= 0)
+    {
+        free(name);
+        return;
+    }
+    if (r->rotated_n == r->keep)
+    {
+        remove_rotated(r->rotated[r->rotated_head]);
+        free(r->rotated[r->rotated_head]);
+        r->rotated[r->rotated_head] = name;
+        r->rotated_head = (r->rotated_head + 1) % r->keep;
+        return;
+    }
+    r->rotated[(r->rotated_head + r->rotated_n++) % r->keep] = name;
+}
+
+static int rotate_now(rotate_t *r)
+{
+    char name[PATH_MAX], stamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+
+    // <path>.<UTC time>, with a counter if several rotations fall in one second
+    gmtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf(name, sizeof(name), "%s.%s", r->path, stamp);
+    for (int i = 1; rotated_exists(name); i++)
+        snprintf(name, sizeof(name), "%s.%s.%d", r->path, stamp, i);
+
+    // The old stream stays open and usable until its successor exists, so a
+    // failed rotation only postpones it
+    FILE *old = r->fp;
+    if (rename(r->path, name) < 0)
+    {
+        r->retry_s = monotonic_s() + ROTATE_RETRY_S;
+        return -1;
+    }
+    if (open_current(r) < 0)
+    {
+        int err = errno;
+        rename(name, r->path);
+        r->retry_s = monotonic_s() + ROTATE_RETRY_S;
+        errno = err;
+        return -1;
+    }
+    fclose(old);
+
+    // One compression at a time; the previous one had a whole rotation period to finish
+    wait_gzip(r);
+    char *argv[] = {"gzip", "-f", "--", name, NULL};
+    if (posix_spawnp(&r->gzip_pid, "gzip", NULL, NULL, argv, environ) != 0)
+        r->gzip_pid = 0; // no gzip: the file stays uncompressed
+
+    char *kept = strdup(name);
+    if (kept)
+        track_rotated(r, kept);
+    return 0;
+}
+
+int rotate_check(rotate_t *r)
+{
+    if (fflush(r->fp) != 0)
+        return -1;
+    if (!r->path)
+        return 0;
+
+    int due = 0;
+    if (r->retry_s && monotonic_s() < r->retry_s)
+        return 0;
+    if (r->max_bytes)
+    {
+        long pos = ftell(r->fp);
+        due = pos >= 0 && (uint64_t)pos >= r->max_bytes;
+    }
+    if (!due && r->max_age_s)
+        due = monotonic_s() - r->opened_s >= r->max_age_s;
+    return due ? rotate_now(r) : 0;
+}
+
+void rotate_close(rotate_t *r)
+{
+    if (r->fp && r->path)
+        fclose(r->fp);
+    else if (r->fp)
+        fflush(r->fp);
+    r->fp = NULL;
+    wait_gzip(r);
+    for (int i = 0; i < r->rotated_n; i++)
+        free(r->rotated[(r->rotated_head + i) % r->keep]);
+    free(r->rotated);
+    free(r->path);
+    free(r->header);
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,42 @@
+#ifndef PINGPONG_ROTATE_H
+#define PINGPONG_ROTATE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Output file that is rotated by size or age. Rotated files are renamed to
+// <path>.<UTC time> and compressed by a background gzip; only the newest
+// `keep` of them are kept.
+typedef struct rotate
+{
+    FILE *fp;           // write through this; stdout when path is NULL
+    char *path;         // NULL: write to stdout and never rotate
+    char *header;       // written at the top of every file, may be NULL
+    uint64_t max_bytes; // rotate once the file is this large, 0 for no limit
+    uint64_t max_age_s; // rotate once the file is this old, 0 for no limit
+    uint64_t opened_s;  // CLOCK_MONOTONIC seconds when fp was opened
+    uint64_t retry_s;   // after a failed rotation, no new attempt before this
+
+    char **rotated;    // ring of rotated file names, oldest at rotated_head
+    int keep;          // capacity of rotated, 0 keeps everything
+    int rotated_n;
+    int rotated_head;
+    pid_t gzip_pid;    // outstanding compression, 0 if none
+} rotate_t;
+
+// rotate_open creates (truncates) path and writes the header. A NULL path
+// writes to stdout. Returns -1 with errno set on failure.
+int rotate_open(rotate_t *r, const char *path, const char *header,
+                uint64_t max_bytes, uint64_t max_age_s, int keep);
+
+// rotate_check flushes the file and rotates it if a limit is reached.
+// Call after each complete record so records never span two files. On
+// failure it returns -1 with errno set and fp stays valid: writing goes on to
+// the current file and the rotation is retried later.
+int rotate_check(rotate_t *r);
+
+// rotate_close flushes and closes the current file and waits for compression
+void rotate_close(rotate_t *r);
+
+#endif // PINGPONG_ROTATE_H
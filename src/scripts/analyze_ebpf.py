@@ -3,17 +3,22 @@
 Modular eBPF pingpong analyzer: parses recorded event logs, matches full ping-pong cycles, computes client/server/network latencies, and writes CSV (and optional CDF plot).
 """
 import argparse
+import bisect
 import csv
+import gzip
 import re
 import sys
 import os
 import subprocess
-from typing import List, Dict, Optional
+from typing import List, Dict, Optional, Tuple
 from functools import partial
 
 EVENT_RE = re.compile(
-    r"ts:(?P<ts>\d+)\s+sock:(?P<sock>\d+)\s+pid:(?P<pid>\d+)\s+type:(?P<type>\w+)\s+srtt:(?P<srtt>\d+)\s+(?P<addr>.+)"
+    r"ts:(?P<ts>\d+)\s+sock:(?P<sock>\d+)\s+pid:(?P<pid>\d+)\s+type:(?P<type>\w+)\s+srtt:(?P<srtt>\d+)"
+    r"(?:\s+cpu:(?P<cpu>\d+)\s+ctx:(?P<ctx>\w+))?(?:\s+(?P<addr>.+))?"
 )
+TOPO_RE = re.compile(r"topo\s+cpu:(?P<cpu>\d+)\s+llc:(?P<llc>-?\d+)\s+node:(?P<node>-?\d+)")
+HANDOFF_CLASSES = ("same_core", "same_llc", "cross_llc", "cross_numa", "cross_core")
 ADDR_RE = re.compile(
     r"(?P<src>\[?[0-9A-Fa-f:\.]+\]?):(?P<srcp>\d+)\s*->\s*(?P<dst>\[?[0-9A-Fa-f:\.]+\]?):(?P<dstp>\d+)"
 )
@@ -30,6 +35,9 @@ class Event:
         dst: str,
         dstp: int,
         srtt_us: int,
+        pid: int = 0,
+        cpu: Optional[int] = None,
+        ctx: Optional[str] = None,
     ):
         self.ts = ts_us
         self.sock = sock
@@ -39,6 +47,13 @@ class Event:
         self.dst = dst.strip("[]")
         self.dstp = dstp
         self.srtt_us = srtt_us
+        self.pid = pid
+        self.cpu = cpu
+        self.ctx = ctx
+
+    @property
+    def is_sched(self) -> bool:
+        return self.type.startswith("sched_")
 
 
 curr_dir = os.path.dirname(os.path.abspath(__file__))
@@ -82,10 +97,18 @@ def parse_line(line: str) -> Optional[Event]:
         return None
     ts_us = int(m.group("ts")) / 1000.0
     sock = int(m.group("sock"))
+    pid = int(m.group("pid"))
+    cpu = int(m.group("cpu")) if m.group("cpu") is not None else None
+    ctx = m.group("ctx")
     evt_type = m.group("type")
     # capture kernel srtt (microseconds)
     srtt_us = int(m.group("srtt"))
     addr = m.group("addr")
+    if addr is None:
+        # scheduler events have no socket endpoints
+        if not evt_type.startswith("sched_"):
+            return None
+        return Event(ts_us, sock, evt_type, "", 0, "", 0, srtt_us, pid, cpu, ctx)
     m2 = ADDR_RE.search(addr)
     if not m2:
         return None
@@ -98,12 +121,22 @@ def parse_line(line: str) -> Optional[Event]:
         dst=m2.group("dst"),
         dstp=int(m2.group("dstp")),
         srtt_us=srtt_us,
+        pid=pid,
+        cpu=cpu,
+        ctx=ctx,
     )
 
 
+def open_log(filepath: str):
+    """Open a tracer log; rotated logs are gzip-compressed."""
+    if filepath.endswith(".gz"):
+        return gzip.open(filepath, "rt")
+    return open(filepath, "r")
+
+
 def load_events(filepath: str) -> List[Event]:
     evts = []
-    with open(filepath, "r") as f:
+    with open_log(filepath) as f:
         for line in f:
             e = parse_line(line)
             if e:
@@ -147,6 +180,8 @@ def extract_cycles(
                 and events[i].dst == client_ip
             )
             cycle["recv_entry"] = events[i].ts
+            cycle["recv_entry_cpu"] = events[i].cpu
+            cycle["recv_entry_ctx"] = events[i].ctx
             # find recv_exit
             i += 1
             if i >= n:
@@ -158,6 +193,8 @@ def extract_cycles(
                 and events[i].dst == client_ip
             )
             cycle["recv_exit"] = events[i].ts
+            cycle["recv_pid"] = events[i].pid
+            cycle["recv_exit_cpu"] = events[i].cpu
             cycles.append(cycle)
         i += 1
     if subcall:
@@ -165,12 +202,115 @@ def extract_cycles(
     return cycles or extract_cycles(events, server_ip, client_ip, subcall=True)
 
 
-def compute_metrics(cycle: Dict) -> Dict:
-    return {
+def first_between(timestamps: List[float], lo: float, hi: float) -> Optional[float]:
+    idx = bisect.bisect_left(timestamps, lo)
+    if idx < len(timestamps) and timestamps[idx] <= hi:
+        return timestamps[idx]
+    return None
+
+
+def attach_sched(cycles: List[Dict], sched_events: List[Event]):
+    """
+    Annotate each cycle with the wakeup and switch-in of the receiving thread
+    that fall between recv_entry and recv_exit. Cycles where the thread was
+    already running (no wakeup in the window) are left untouched.
+    """
+    timeline: Dict[int, Dict[str, List[float]]] = {}
+    for e in sched_events:
+        per_pid = timeline.setdefault(e.pid, {"sched_wakeup": [], "sched_switch": []})
+        per_pid[e.type].append(e.ts)
+    for cycle in cycles:
+        per_pid = timeline.get(cycle["recv_pid"])
+        if not per_pid:
+            continue
+        wakeup = first_between(
+            per_pid["sched_wakeup"], cycle["recv_entry"], cycle["recv_exit"]
+        )
+        if wakeup is None:
+            continue
+        oncpu = first_between(per_pid["sched_switch"], wakeup, cycle["recv_exit"])
+        if oncpu is None:
+            continue
+        cycle["wakeup"] = wakeup
+        cycle["oncpu"] = oncpu
+
+
+def compute_metrics(cycle: Dict, with_sched: bool = False) -> Dict:
+    metrics = {
         "send_stack_us": cycle["send_exit"] - cycle["send_entry"],
         "recv_stack_us": cycle["recv_exit"] - cycle["recv_entry"],
         "network_latency_us": cycle["srtt_us"],
     }
+    if with_sched:
+        # recv_stack_us split: softirq -> wakeup -> on-CPU -> recvmsg return
+        if "oncpu" in cycle:
+            metrics["recv_softirq_us"] = cycle["wakeup"] - cycle["recv_entry"]
+            metrics["recv_wakeup_us"] = cycle["oncpu"] - cycle["wakeup"]
+            metrics["recv_copyout_us"] = cycle["recv_exit"] - cycle["oncpu"]
+        else:
+            metrics["recv_softirq_us"] = ""
+            metrics["recv_wakeup_us"] = ""
+            metrics["recv_copyout_us"] = ""
+    return metrics
+
+
+def load_topology(filepath: str) -> Dict[int, Tuple[int, int]]:
+    """Map CPU id to (LLC id, NUMA node) from the tracer's topo lines."""
+    topo = {}
+    with open_log(filepath) as f:
+        for line in f:
+            m = TOPO_RE.search(line)
+            if m:
+                topo[int(m.group("cpu"))] = (int(m.group("llc")), int(m.group("node")))
+    return topo
+
+
+def classify_handoff(
+    entry_cpu: int, exit_cpu: int, topo: Dict[int, Tuple[int, int]]
+) -> str:
+    """Classify the move from the recv_entry CPU to the recv_exit CPU."""
+    if entry_cpu == exit_cpu:
+        return "same_core"
+    if entry_cpu not in topo or exit_cpu not in topo:
+        return "cross_core"
+    entry_llc, entry_node = topo[entry_cpu]
+    exit_llc, exit_node = topo[exit_cpu]
+    # -1 marks info sysfs did not provide: without an LLC id nothing more is
+    # known, without a node (non-NUMA kernels) the LLC ids are still compared
+    if entry_llc < 0 or exit_llc < 0:
+        return "cross_core"
+    if entry_node >= 0 and exit_node >= 0 and entry_node != exit_node:
+        return "cross_numa"
+    if entry_llc == exit_llc:
+        return "same_llc"
+    return "cross_llc"
+
+
+def report_handoffs(name: str, cycles: List[Dict], topo: Dict[int, Tuple[int, int]]):
+    """Print recv_stack_us percentiles grouped by receive-path CPU handoff."""
+    groups: Dict[str, List[float]] = {}
+    contexts: Dict[str, int] = {}
+    for c in cycles:
+        if c.get("recv_entry_cpu") is None or c.get("recv_exit_cpu") is None:
+            continue
+        cls = classify_handoff(c["recv_entry_cpu"], c["recv_exit_cpu"], topo)
+        groups.setdefault(cls, []).append(c["recv_exit"] - c["recv_entry"])
+        contexts[c["recv_entry_ctx"]] = contexts.get(c["recv_entry_ctx"], 0) + 1
+    total = sum(len(v) for v in groups.values())
+    if not total:
+        return
+    print(f"Receive handoff (recv_entry -> recv_exit CPU) for {name}:")
+    for cls in HANDOFF_CLASSES:
+        vals = sorted(groups.get(cls, []))
+        if not vals:
+            continue
+        pct = {p: vals[min(len(vals) - 1, int(len(vals) * p / 100))] for p in (50, 90, 99)}
+        print(
+            f"  {cls:<10} n={len(vals):<8} share={100.0 * len(vals) / total:5.1f}%  "
+            f"recv_stack_us p50={pct[50]:.2f} p90={pct[90]:.2f} p99={pct[99]:.2f}"
+        )
+    parts = [f"{ctx}={100.0 * n / total:.1f}%" for ctx, n in sorted(contexts.items())]
+    print("  recv_entry context: " + ", ".join(parts))
 
 
 def write_csv(output: str, metrics: List[Dict]):
@@ -186,11 +326,14 @@ def write_csv(output: str, metrics: List[Dict]):
 
 def process_input(
     input_path: str, client_ip: str, server_ip: str, smart_skip: bool = True
-) -> List[Event]:
+) -> Tuple[List[Event], List[Event]]:
     """
-    Process a single input file and return a list of parsed events.
+    Process a single input file and return the socket events and the
+    scheduler events (empty unless the tracer ran with --sched).
     """
     events = load_events(input_path)
+    sched_events = [e for e in events if e.is_sched]
+    events = [e for e in events if not e.is_sched]
 
     # filter events by client/server IPs
     events = list(
@@ -247,7 +390,9 @@ def process_input(
         print(f"No events found in {input_path} after filtering.", file=sys.stderr)
     else:
         print(f"Loaded {len(events)} events from {input_path}")
-    return events
+    if sched_events:
+        print(f"Loaded {len(sched_events)} scheduler events from {input_path}")
+    return events, sched_events
 
 
 def main():
@@ -264,13 +409,20 @@ def main():
     cycs = list(
         map(
             partial(extract_cycles, client_ip=args.client_ip, server_ip=args.server_ip),
-            evts,
+            (events for events, _ in evts),
         )
     )
+    for cycle, (_, sched_events) in zip(cycs, evts):
+        attach_sched(cycle, sched_events)
 
-    metrics = [[compute_metrics(c) for c in cycle] for cycle in cycs]
+    metrics = [
+        [compute_metrics(c, with_sched=bool(sched_events)) for c in cycle]
+        for cycle, (_, sched_events) in zip(cycs, evts)
+    ]
     for f, m in zip(args.inputs, metrics):
         write_csv(os.path.splitext(f)[0] + ".csv", m)
+    for f, cycle in zip(args.inputs, cycs):
+        report_handoffs(f, cycle, load_topology(f))
     if args.plot:
         plot_py = os.path.abspath(os.path.join(curr_dir, "plot_cdf.py"))
         for f in args.inputs:
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Probe overhead report: joins a client CSV recorded while pingpong-ebpf ran with
+--overhead-bench against the tracer's phase markers, and summarizes end-to-end
+latency per probe phase together with the self-timed per-hook histograms.
+"""
+import argparse
+import bisect
+import csv
+import os
+import re
+import sys
+from typing import Dict, List, Tuple
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from analyze_ebpf import open_log  # noqa: E402
+
+PHASE_RE = re.compile(
+    r"phase:(?P<phase>\w+)\s+ts:(?P<ts>\d+)\s+ts_real_us:(?P<real>\d+)"
+)
+HOOK_RE = re.compile(
+    r"overhead\s+hook:(?P<hook>\w+)\s+bucket_ns:(?P<bucket>\d+)\s+count:(?P<count>\d+)"
+)
+PHASES = ("attached", "self_timed", "early_out", "detached")
+PERCENTILES = (50, 90, 99, 99.9)
+
+
+def parse_args():
+    p = argparse.ArgumentParser(description="Report eBPF probe overhead per phase.")
+    p.add_argument(
+        "--client-csv",
+        required=True,
+        help="Client CSV (default mode, realtime send/recv timestamps)",
+    )
+    p.add_argument(
+        "--ebpf-log",
+        nargs="+",
+        required=True,
+        help="pingpong-ebpf output with phase markers; list rotated (.gz) files oldest first",
+    )
+    p.add_argument(
+        "--guard-ms",
+        type=float,
+        default=100.0,
+        help="Ignore samples this long after each phase switch",
+    )
+    return p.parse_args()
+
+
+def load_log(paths: List[str]) -> Tuple[List[Tuple[int, str]], Dict[str, Dict[int, int]]]:
+    """Return (phase start in realtime us, phase) markers and per-hook histograms."""
+    phases = []
+    hooks: Dict[str, Dict[int, int]] = {}
+    for path in paths:
+        with open_log(path) as f:
+            for line in f:
+                m = PHASE_RE.search(line)
+                if m:
+                    phases.append((int(m.group("real")), m.group("phase")))
+                    continue
+                m = HOOK_RE.search(line)
+                if m:
+                    buckets = hooks.setdefault(m.group("hook"), {})
+                    buckets[int(m.group("bucket"))] = int(m.group("count"))
+    phases.sort()
+    return phases, hooks
+
+
+def load_rtts(path: str) -> List[Tuple[int, float]]:
+    """Return (send timestamp in realtime us, round trip in us) per iteration."""
+    rows = []
+    with open(path, "r") as f:
+        for row in csv.DictReader(f):
+            try:
+                send_us = int(row["send_entry_us"])
+                recv_us = int(row["recv_entry_us"])
+            except (KeyError, ValueError):
+                continue
+            rows.append((send_us, float(recv_us - send_us)))
+    return rows
+
+
+def split_by_phase(
+    rows: List[Tuple[int, float]], phases: List[Tuple[int, str]], guard_us: float
+) -> Dict[str, List[float]]:
+    starts = [ts for ts, _ in phases]
+    samples: Dict[str, List[float]] = {name: [] for name in PHASES}
+    for send_us, rtt in rows:
+        idx = bisect.bisect_right(starts, send_us) - 1
+        if idx < 0:
+            continue
+        start, phase = phases[idx]
+        if send_us - start < guard_us:
+            continue
+        samples.setdefault(phase, []).append(rtt)
+    return samples
+
+
+def percentile(sorted_vals: List[float], pct: float) -> float:
+    if not sorted_vals:
+        return float("nan")
+    k = (len(sorted_vals) - 1) * pct / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(sorted_vals) - 1)
+    return sorted_vals[lo] + (sorted_vals[hi] - sorted_vals[lo]) * (k - lo)
+
+
+def hist_percentile(buckets: Dict[int, int], pct: float) -> int:
+    """Upper bound (ns) of the log2 bucket holding the percentile."""
+    total = sum(buckets.values())
+    target = total * pct / 100.0
+    seen = 0
+    for lower in sorted(buckets):
+        seen += buckets[lower]
+        if seen >= target:
+            return lower * 2
+    return 0
+
+
+def print_phase_report(samples: Dict[str, List[float]]):
+    print("End-to-end round trip per probe phase (microseconds):")
+    stats = {}
+    for phase in PHASES:
+        vals = sorted(samples.get(phase, []))
+        stats[phase] = {p: percentile(vals, p) for p in PERCENTILES}
+        parts = [f"p{p:g}={stats[phase][p]:.2f}" for p in PERCENTILES]
+        print(f"  {phase:<10} n={len(vals):<8} " + ", ".join(parts))
+
+    print("\nObserver effect (difference of percentiles, microseconds):")
+    pairs = (
+        ("attached", "detached", "full probes"),
+        ("early_out", "detached", "trampolines + early-out"),
+        ("attached", "early_out", "probe bodies + ring buffer"),
+        ("self_timed", "attached", "self-timing (bench only)"),
+    )
+    for a, b, label in pairs:
+        parts = [f"p{p:g}={stats[a][p] - stats[b][p]:+.2f}" for p in PERCENTILES]
+        print(f"  {label:<28} " + ", ".join(parts))
+
+
+def print_hook_report(hooks: Dict[str, Dict[int, int]]):
+    if not hooks:
+        print("\nNo per-hook histograms found; was the tracer stopped cleanly?")
+        return
+    print("\nPer-hook run time from the self_timed phase (nanoseconds, log2 bucket upper bounds):")
+    for hook, buckets in sorted(hooks.items()):
+        total = sum(buckets.values())
+        # bucket midpoint 1.5 * lower bound approximates the mean
+        mean = sum(1.5 * lower * n for lower, n in buckets.items()) / total
+        parts = [f"p{p:g}<={hist_percentile(buckets, p)}" for p in PERCENTILES]
+        print(f"  {hook:<13} n={total:<10} mean~{mean:.0f} " + ", ".join(parts))
+
+
+def main():
+    args = parse_args()
+    phases, hooks = load_log(args.ebpf_log)
+    if not phases:
+        print("No phase markers found; run pingpong-ebpf with --overhead-bench.", file=sys.stderr)
+        sys.exit(1)
+    rows = load_rtts(args.client_csv)
+    if not rows:
+        print("No samples in client CSV.", file=sys.stderr)
+        sys.exit(1)
+    samples = split_by_phase(rows, phases, args.guard_ms * 1000.0)
+    print_phase_report(samples)
+    print_hook_report(hooks)
+
+
+if __name__ == "__main__":
+    main()
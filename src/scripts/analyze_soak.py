@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Soak run report: merges the per-window summary CSVs written by
+pingpong-client --duration (the current file and its rotated .gz siblings)
+into overall round-trip percentiles, and lists the slowest windows.
+"""
+import argparse
+import csv
+import glob
+import gzip
+import sys
+from typing import Dict, List
+
+PERCENTILES = (50, 90, 99, 99.9)
+
+
+def parse_args():
+    p = argparse.ArgumentParser(description="Summarize a pingpong-client soak run.")
+    p.add_argument(
+        "--input",
+        required=True,
+        help="Summary CSV given to pingpong-client --output; rotated files are found next to it",
+    )
+    p.add_argument("--top", type=int, default=10, help="Number of slowest windows to list")
+    p.add_argument("--plot", help="Write p50/p99/max over time to this image file")
+    return p.parse_args()
+
+
+def summary_files(path: str) -> List[str]:
+    # Rotated files are <path>.<UTC time>[.N][.gz]; the raw sample files are not summaries
+    rotated = [f for f in glob.glob(glob.escape(path) + ".*") if not f.startswith(path + ".raw")]
+    # While gzip runs (or if it died before unlinking) a file exists both plain
+    # and compressed. The plain one is always complete, so it wins.
+    by_stem: Dict[str, str] = {}
+    for f in rotated:
+        stem = f[: -len(".gz")] if f.endswith(".gz") else f
+        if stem not in by_stem or not f.endswith(".gz"):
+            by_stem[stem] = f
+    return [by_stem[stem] for stem in sorted(by_stem)] + [path]
+
+
+def load_windows(files: List[str]) -> List[Dict]:
+    windows = []
+    for path in files:
+        opener = gzip.open if path.endswith(".gz") else open
+        try:
+            with opener(path, "rt") as f:
+                for row in csv.DictReader(f):
+                    try:
+                        hist = {}
+                        for pair in row["hist"].split():
+                            lower, count = pair.split(":")
+                            hist[int(lower)] = int(count)
+                        windows.append(
+                            {
+                                "start_us": int(row["window_start_us"]),
+                                "count": int(row["count"]),
+                                "p50_us": int(row["p50_us"]),
+                                "p99_us": int(row["p99_us"]),
+                                "max_us": int(row["max_us"]),
+                                "raw_rows": int(row["raw_rows"]),
+                                "hist": hist,
+                            }
+                        )
+                    except (KeyError, ValueError):
+                        continue
+        except (OSError, EOFError) as e:
+            # a rotated file may still be in the middle of compression
+            print(f"Skipping {path}: {e}", file=sys.stderr)
+    windows.sort(key=lambda w: w["start_us"])
+    return windows
+
+
+def hist_percentile(hist: Dict[int, int], pct: float) -> int:
+    """Lower bound (us) of the histogram bucket holding the percentile."""
+    total = sum(hist.values())
+    target = max(1, round(total * pct / 100.0))
+    seen = 0
+    for lower in sorted(hist):
+        seen += hist[lower]
+        if seen >= target:
+            return lower
+    return 0
+
+
+def print_report(windows: List[Dict], top: int):
+    merged: Dict[int, int] = {}
+    for w in windows:
+        for lower, count in w["hist"].items():
+            merged[lower] = merged.get(lower, 0) + count
+    total = sum(w["count"] for w in windows)
+    span_s = (windows[-1]["start_us"] - windows[0]["start_us"]) / 1e6
+    print(f"Windows: {len(windows)} over {span_s:.0f} s, {total} round trips")
+    parts = [f"p{p:g}={hist_percentile(merged, p)}" for p in PERCENTILES]
+    print("Round trip (us, histogram bucket lower bounds): " + ", ".join(parts)
+          + f", max={max(w['max_us'] for w in windows)}")
+
+    kept = [w for w in windows if w["raw_rows"]]
+    print(f"Windows with raw samples kept: {len(kept)}")
+
+    print(f"\nSlowest {min(top, len(windows))} windows by p99:")
+    for w in sorted(windows, key=lambda w: w["p99_us"], reverse=True)[:top]:
+        raw = " raw" if w["raw_rows"] else ""
+        print(
+            f"  start_us={w['start_us']} n={w['count']} p50={w['p50_us']} "
+            f"p99={w['p99_us']} max={w['max_us']}{raw}"
+        )
+
+
+def plot_windows(windows: List[Dict], output: str):
+    import matplotlib.pyplot as plt
+
+    t0 = windows[0]["start_us"]
+    hours = [(w["start_us"] - t0) / 3.6e9 for w in windows]
+    plt.figure(figsize=(10, 5))
+    for key in ("p50_us", "p99_us", "max_us"):
+        plt.plot(hours, [w[key] for w in windows], label=key)
+    plt.yscale("log")
+    plt.xlabel("Time since start (h)")
+    plt.ylabel("Round trip (us)")
+    plt.legend()
+    plt.grid(True)
+    plt.tight_layout()
+    plt.savefig(output)
+
+
+def main():
+    args = parse_args()
+    windows = load_windows(summary_files(args.input))
+    if not windows:
+        print("No windows found; was the client run with --duration?", file=sys.stderr)
+        sys.exit(1)
+    print_report(windows, args.top)
+    if args.plot:
+        plot_windows(windows, args.plot)
+
+
+if __name__ == "__main__":
+    main()
@@ -39,7 +39,8 @@ def load_metrics(csv_path):
                     vals.append(float(row[field]))
                 except ValueError:
                     pass
-    return data
+    # drop metrics with no numeric samples (e.g. optional columns left empty)
+    return {name: vals for name, vals in data.items() if vals}
 
 
 def compute_percentiles(data, percentiles):
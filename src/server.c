@@ -6,21 +6,113 @@
 #include <sys/socket.h>
 #include <stdint.h>
 #include <errno.h>
-#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "common.h"
+#include "uring.h"
 
 #define BACKLOG 1
 #define BUFSIZE 65536
 
+// How long to wait for TX stamps after each echo
+#define TS_TX_TIMEOUT_MS 10
+
+// Echo loop that records the server-side SO_TIMESTAMPING breakdown.
+// Returns the number of completed echoes.
+static uint64_t run_timestamped(int exp_fd, char *buf, uint32_t size, uint32_t count, FILE *fp)
+{
+    fprintf(fp, "seq,send_stack_us,recv_stack_us,network_latency_us,nic_turnaround_us\n");
+
+    uint32_t sent = 0; // bytes sent since timestamping was enabled (wraps like OPT_ID)
+    uint64_t done = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ts_sample_t tx, rx;
+        if (recv_all_ts(exp_fd, buf, size, &rx) < 0)
+        {
+            perror("recv experiment");
+            break;
+        }
+        uint64_t recv_ns = realtime_ns();
+        if (send_all(exp_fd, buf, size) < 0)
+        {
+            perror("send experiment");
+            break;
+        }
+        sent += size;
+
+        int have_tx = ts_collect_tx(exp_fd, sent - 1, &tx, TS_TX_TIMEOUT_MS) == 0;
+        uint64_t tx_ns = tx.sw_ns ? tx.sw_ns : tx.sched_ns;
+        struct tcp_info ti;
+        socklen_t ti_len = sizeof(ti);
+        if (getsockopt(exp_fd, IPPROTO_TCP, TCP_INFO, &ti, &ti_len) < 0)
+            ti.tcpi_rtt = 0;
+
+        // The send starts right after recv_ns, so both stack times share that mark
+        fprintf(fp, "%u,", i);
+        if (have_tx && tx_ns)
+            fprintf(fp, "%.3f", (double)(int64_t)(tx_ns - recv_ns) / 1000.0);
+        fprintf(fp, ",");
+        if (rx.sw_ns)
+            fprintf(fp, "%.3f", (double)(int64_t)(recv_ns - rx.sw_ns) / 1000.0);
+        fprintf(fp, ",%u,", ti.tcpi_rtt);
+        if (tx.hw_ns && rx.hw_ns)
+            fprintf(fp, "%.3f", (double)(int64_t)(tx.hw_ns - rx.hw_ns) / 1000.0);
+        fprintf(fp, "\n");
+        done++;
+    }
+    return done;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 3 || strcmp(argv[1], "--port") != 0)
+    int control_port = 0;
+    char *output = NULL;
+    int io_backend = IO_BACKEND_BLOCKING;
+    int sqpoll = 0;
+
+    static struct option long_options[] = {
+        {"port", required_argument, 0, 'p'},
+        {"output", required_argument, 0, 'o'},
+        {"io", required_argument, 0, 'i'},
+        {"sqpoll", no_argument, 0, 'q'},
+        {0, 0, 0, 0}};
+
+    int c;
+    int option_index = 0;
+    while ((c = getopt_long(argc, argv, "p:o:i:q", long_options, &option_index)) != -1)
+    {
+        switch (c)
+        {
+        case 'p':
+            control_port = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'i':
+            io_backend = parse_io_backend(optarg);
+            if (io_backend < 0)
+            {
+                fprintf(stderr, "Unknown I/O backend: %s (expected blocking or uring)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'q':
+            sqpoll = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s --port <control_port> [--output <file>] [--io blocking|uring] [--sqpoll]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (control_port <= 0)
     {
-        fprintf(stderr, "Usage: %s --port <control_port>\n", argv[0]);
+        fprintf(stderr, "Usage: %s --port <control_port> [--output <file>] [--io blocking|uring] [--sqpoll]\n", argv[0]);
         return EXIT_FAILURE;
     }
-    int control_port = atoi(argv[2]);
 
     // Control listener setup
     int control_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -69,6 +161,9 @@ int main(int argc, char *argv[])
     uint32_t size = ntohl(neg_net.size);
     uint32_t count = ntohl(neg_net.count);
     uint16_t exp_port = ntohs(neg_net.exp_port);
+    uint8_t flags = 0;
+    if (neg_net.magic == NEG_MAGIC && !(neg_net.flags & ~NEG_FLAGS_KNOWN))
+        flags = neg_net.flags;
 
     // Attempt to set up experiment listener and notify client on control channel
     int exp_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -112,6 +207,7 @@ int main(int argc, char *argv[])
     }
     close(conn_fd);
     close(control_fd);
+    io_syscalls = 0; // count only the experiment connection
 
     printf("Experiment listening on port %u...\n", exp_port);
     int exp_fd = accept(exp_listen_fd, NULL, NULL);
@@ -122,6 +218,31 @@ int main(int argc, char *argv[])
     }
     printf("Experiment connection established\n");
 
+    // Timestamps are only recorded when the client asked for them and there is somewhere to write them
+    FILE *fp = NULL;
+    if ((flags & NEG_FLAG_TIMESTAMPING) && !output)
+    {
+        fprintf(stderr, "Client requested timestamping but no --output was given; echoing only\n");
+    }
+    else if ((flags & NEG_FLAG_TIMESTAMPING) && io_backend != IO_BACKEND_BLOCKING)
+    {
+        fprintf(stderr, "Client requested timestamping, which needs --io blocking; echoing only\n");
+    }
+    else if (flags & NEG_FLAG_TIMESTAMPING)
+    {
+        if (ts_enable(exp_fd) < 0)
+        {
+            perror("setsockopt SO_TIMESTAMPING");
+            return EXIT_FAILURE;
+        }
+        fp = fopen(output, "w");
+        if (!fp)
+        {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+    }
+
     // Read exactly size bytes and echo back
     char *buf = malloc(size);
     if (!buf)
@@ -129,19 +250,56 @@ int main(int argc, char *argv[])
         perror("malloc");
         return EXIT_FAILURE;
     }
-    for (uint32_t i = 0; i < count; i++)
+    // A count of 0 (client --duration) echoes until the client closes the connection
+    uint64_t syscalls = 0;
+    uint64_t echoes = 0;
+    if (fp)
+    {
+        echoes = run_timestamped(exp_fd, buf, size, count, fp);
+        fclose(fp);
+        syscalls = io_syscalls;
+    }
+    else if (io_backend == IO_BACKEND_URING)
     {
-        if (recv_all(exp_fd, buf, size) < 0)
+        uring_conn_t uring;
+        if (uring_conn_init(&uring, exp_fd, buf, size, sqpoll) < 0)
         {
-            perror("recv experiment");
-            break;
+            perror("io_uring setup");
+            return EXIT_FAILURE;
         }
-        if (send_all(exp_fd, buf, size) < 0)
+        // Each echo is a linked recv -> send pair reaped with one io_uring_enter
+        for (; count == 0 || echoes < count; echoes++)
         {
-            perror("send experiment");
-            break;
+            if (uring_conn_echo(&uring) < 0)
+            {
+                if (count)
+                    perror("echo experiment");
+                break;
+            }
+        }
+        syscalls = uring_conn_syscalls(&uring);
+        uring_conn_close(&uring);
+    }
+    else
+    {
+        for (; count == 0 || echoes < count; echoes++)
+        {
+            if (recv_all(exp_fd, buf, size) < 0)
+            {
+                if (count)
+                    perror("recv experiment");
+                break;
+            }
+            if (send_all(exp_fd, buf, size) < 0)
+            {
+                perror("send experiment");
+                break;
+            }
         }
+        syscalls = io_syscalls;
     }
+    printf("I/O syscalls: %llu (%.2f per iteration)\n", (unsigned long long)syscalls,
+           echoes > 0 ? (double)syscalls / echoes : 0.0);
     free(buf);
     close(exp_fd);
     close(exp_listen_fd);
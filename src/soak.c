@@ -0,0 +1,123 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "soak.h"
+
+static unsigned hist_index(uint64_t v)
+{
+    if (v < SOAK_HIST_SUB)
+        return v;
+    unsigned shift = 63 - __builtin_clzll(v) - SOAK_HIST_SUB_BITS;
+    return (shift + 1) * SOAK_HIST_SUB + ((v >> shift) & (SOAK_HIST_SUB - 1));
+}
+
+static uint64_t hist_lower(unsigned idx)
+{
+    if (idx < SOAK_HIST_SUB)
+        return idx;
+    unsigned shift = idx / SOAK_HIST_SUB - 1;
+    return (uint64_t)(SOAK_HIST_SUB | (idx % SOAK_HIST_SUB)) << shift;
+}
+
+void soak_window_reset(soak_window_t *w, uint64_t start_us)
+{
+    // The raw buffer is reused so steady state does no allocation
+    soak_sample_t *raw = w->raw;
+    size_t raw_cap = w->raw_cap;
+
+    memset(w, 0, sizeof(*w));
+    w->start_us = start_us;
+    w->min_us = UINT64_MAX;
+    w->raw = raw;
+    w->raw_cap = raw_cap;
+}
+
+void soak_window_add(soak_window_t *w, const soak_sample_t *s, int keep_raw)
+{
+    uint64_t rtt = s->recv_entry_us - s->send_entry_us;
+
+    w->count++;
+    w->sum_us += rtt;
+    if (rtt < w->min_us)
+        w->min_us = rtt;
+    if (rtt > w->max_us)
+        w->max_us = rtt;
+    w->hist[hist_index(rtt)]++;
+
+    if (!keep_raw)
+        return;
+    if (w->raw_n == w->raw_cap)
+    {
+        size_t cap = w->raw_cap ? w->raw_cap * 2 : 4096;
+        soak_sample_t *raw = cap <= SOAK_RAW_MAX ? realloc(w->raw, cap * sizeof(*raw)) : NULL;
+        if (!raw)
+        {
+            w->raw_dropped++;
+            return;
+        }
+        w->raw = raw;
+        w->raw_cap = cap;
+    }
+    w->raw[w->raw_n++] = *s;
+}
+
+uint64_t soak_window_percentile(const soak_window_t *w, double pct)
+{
+    if (!w->count)
+        return 0;
+    uint64_t rank = (uint64_t)(pct / 100.0 * w->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < SOAK_HIST_BUCKETS; i++)
+    {
+        seen += w->hist[i];
+        if (seen >= rank)
+        {
+            uint64_t v = hist_lower(i);
+            return v < w->min_us ? w->min_us : v;
+        }
+    }
+    return w->max_us;
+}
+
+size_t soak_window_write(const soak_window_t *w, FILE *summary, FILE *raw, uint64_t tail_threshold_us)
+{
+    if (!w->count)
+        return 0;
+
+    uint64_t p99 = soak_window_percentile(w, 99);
+    size_t raw_rows = (raw && tail_threshold_us && p99 > tail_threshold_us) ? w->raw_n : 0;
+
+    fprintf(summary, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.2f,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                     ",%" PRIu64 ",%" PRIu64 ",%zu,%" PRIu64 ",",
+            w->start_us, w->count, w->min_us, (double)w->sum_us / w->count,
+            soak_window_percentile(w, 50), soak_window_percentile(w, 90), p99,
+            soak_window_percentile(w, 99.9), w->max_us, raw_rows, raw_rows ? w->raw_dropped : 0);
+    const char *sep = "";
+    for (unsigned i = 0; i < SOAK_HIST_BUCKETS; i++)
+    {
+        if (w->hist[i])
+        {
+            fprintf(summary, "%s%" PRIu64 ":%" PRIu64, sep, hist_lower(i), w->hist[i]);
+            sep = " ";
+        }
+    }
+    fprintf(summary, "\n");
+
+    for (size_t i = 0; i < raw_rows; i++)
+    {
+        const soak_sample_t *s = &w->raw[i];
+        fprintf(raw, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                s->seq, s->send_entry_us, s->send_exit_us, s->recv_entry_us, s->syscalls);
+    }
+    return raw_rows;
+}
+
+void soak_window_free(soak_window_t *w)
+{
+    free(w->raw);
+    memset(w, 0, sizeof(*w));
+}
@@ -0,0 +1,65 @@
+#ifndef PINGPONG_SOAK_H
+#define PINGPONG_SOAK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear histogram: values below 2^SOAK_HIST_SUB_BITS are exact, larger
+// ones fall into 2^SOAK_HIST_SUB_BITS buckets per power of two (<= 6.25% wide)
+#define SOAK_HIST_SUB_BITS 4
+#define SOAK_HIST_SUB (1U << SOAK_HIST_SUB_BITS)
+#define SOAK_HIST_BUCKETS ((64 - SOAK_HIST_SUB_BITS + 1) * SOAK_HIST_SUB)
+
+// Raw samples buffered per window before the rest of the window is dropped (~40 MiB)
+#define SOAK_RAW_MAX (1U << 20)
+
+// Summary CSV written once per window; hist holds "lower_us:count" pairs
+#define SOAK_SUMMARY_HEADER "window_start_us,count,min_us,mean_us,p50_us,p90_us,p99_us,p999_us,max_us," \
+                            "raw_rows,raw_dropped,hist\n"
+
+// One ping-pong iteration, as in the client's plain CSV. The timestamps are
+// monotonic plus one realtime offset per window, so their differences never
+// see clock steps.
+typedef struct soak_sample
+{
+    uint64_t seq;
+    uint64_t send_entry_us;
+    uint64_t send_exit_us;
+    uint64_t recv_entry_us;
+    uint64_t syscalls;
+} soak_sample_t;
+
+// Aggregate of the round trips (recv_entry_us - send_entry_us) of one window
+typedef struct soak_window
+{
+    uint64_t start_us;
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t min_us;
+    uint64_t max_us;
+    uint64_t hist[SOAK_HIST_BUCKETS];
+
+    soak_sample_t *raw; // samples of this window, kept until it is known whether its tail is slow
+    size_t raw_n;
+    size_t raw_cap;
+    uint64_t raw_dropped;
+} soak_window_t;
+
+// soak_window_reset starts a new, empty window at start_us
+void soak_window_reset(soak_window_t *w, uint64_t start_us);
+
+// soak_window_add accounts one iteration; keep_raw buffers it as a raw sample
+void soak_window_add(soak_window_t *w, const soak_sample_t *s, int keep_raw);
+
+// soak_window_percentile returns the lower bound of the bucket holding pct
+uint64_t soak_window_percentile(const soak_window_t *w, double pct);
+
+// soak_window_write appends the window's summary row. If raw is given and the
+// window's p99 exceeds tail_threshold_us, its raw samples go there as well.
+// Returns the number of raw rows written.
+size_t soak_window_write(const soak_window_t *w, FILE *summary, FILE *raw, uint64_t tail_threshold_us);
+
+void soak_window_free(soak_window_t *w);
+
+#endif // PINGPONG_SOAK_H
@@ -0,0 +1,424 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "uring.h"
+
+#define URING_ENTRIES 8
+#define URING_SQ_IDLE_MS 2000 // SQPOLL thread sleeps after this much idle time
+#define URING_BUF_GROUP 0
+#define URING_BR_ENTRIES 16 // provided buffers; must be a power of two
+#define URING_BR_BUF_MAX 65536
+#define URING_SPIN_LOOPS 1000000 // SQPOLL: CQ polls before blocking in io_uring_enter
+
+// user_data tags of the submitted operations
+enum uring_op
+{
+    UD_SEND = 1,
+    UD_RECV,      // multishot recv into provided buffers
+    UD_ECHO_RECV, // recv half of a linked echo
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int uring_init(uring_t *r, unsigned entries, int sqpoll)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (sqpoll)
+    {
+        p.flags |= IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = URING_SQ_IDLE_MS;
+    }
+
+    r->ring_fd = sys_io_uring_setup(entries, &p);
+    if (r->ring_fd < 0)
+        return -1;
+    r->sqpoll = sqpoll;
+
+    r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        if (r->cq_ring_sz > r->sq_ring_sz)
+            r->sq_ring_sz = r->cq_ring_sz;
+        r->cq_ring_sz = r->sq_ring_sz;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->ring_fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        return -1;
+    if (single_mmap)
+    {
+        r->cq_ptr = r->sq_ptr;
+    }
+    else
+    {
+        r->cq_ptr = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         r->ring_fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            return -1;
+    }
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->ring_fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        return -1;
+
+    char *sq = r->sq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_flags = (unsigned *)(sq + p.sq_off.flags);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->sq_local_tail = *r->sq_tail;
+
+    char *cq = r->cq_ptr;
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *r)
+{
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sq_local_tail - head > *r->sq_mask)
+        return NULL; // full
+    unsigned idx = r->sq_local_tail & *r->sq_mask;
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static unsigned uring_cq_ready(uring_t *r)
+{
+    return __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) - *r->cq_head;
+}
+
+// Publish queued SQEs and wait until at least wait_nr CQEs are ready. With
+// SQPOLL this only enters the kernel to wake an idle poller thread, and waits
+// by spinning on the CQ ring for a bounded time before blocking (so the
+// poller thread is not starved when it shares a CPU with us).
+static int uring_submit_and_wait(uring_t *r, unsigned wait_nr)
+{
+    unsigned to_submit = r->sq_local_tail - *r->sq_tail;
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+
+    if (r->sqpoll)
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (to_submit && (__atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP))
+        {
+            r->enters++;
+            if (sys_io_uring_enter(r->ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP) < 0)
+                return -1;
+        }
+        for (int spins = 0; spins < URING_SPIN_LOOPS; spins++)
+        {
+            if (uring_cq_ready(r) >= wait_nr)
+                return 0;
+        }
+        to_submit = 0;
+    }
+
+    if (!to_submit && uring_cq_ready(r) >= wait_nr)
+        return 0;
+    for (;;)
+    {
+        r->enters++;
+        int ret = sys_io_uring_enter(r->ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0)
+            return 0;
+        if (errno != EINTR)
+            return -1;
+        to_submit = 0; // already consumed by the kernel
+    }
+}
+
+static struct io_uring_cqe *uring_peek_cqe(uring_t *r)
+{
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &r->cqes[head & *r->cq_mask];
+}
+
+static void uring_cqe_seen(uring_t *r)
+{
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static void buf_ring_recycle(uring_conn_t *c, unsigned bid)
+{
+    struct io_uring_buf *b = &c->br->bufs[c->br_tail & (c->br_entries - 1)];
+    b->addr = (uintptr_t)(c->br_bufs + (size_t)bid * c->br_buf_size);
+    b->len = c->br_buf_size;
+    b->bid = bid;
+    c->br_tail++;
+    __atomic_store_n(&c->br->tail, (__u16)c->br_tail, __ATOMIC_RELEASE);
+}
+
+static int arm_recv(uring_conn_t *c)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&c->ring);
+    if (!sqe)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = 0; // registered file index
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = UD_RECV;
+    c->recv_armed = 1;
+    return 0;
+}
+
+static void handle_recv_cqe(uring_conn_t *c, const struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+        c->recv_armed = 0;
+    if (cqe->res == -ENOBUFS)
+        return; // all provided buffers in use; re-armed by the caller
+    if (cqe->res <= 0)
+    {
+        c->rx_eof = 1;
+        errno = cqe->res < 0 ? -cqe->res : ECONNRESET;
+        return;
+    }
+
+    // Lock-step ping-pong: the peer never sends past the current message
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    size_t n = (size_t)cqe->res;
+    if (n > c->size - c->rx_have)
+        n = c->size - c->rx_have;
+    memcpy(c->buf + c->rx_have, c->br_bufs + (size_t)bid * c->br_buf_size, n);
+    c->rx_have += n;
+    buf_ring_recycle(c, bid);
+}
+
+// Consume all ready CQEs. Returns 1 and the result of the operation tagged
+// `tag` if it completed, 0 otherwise.
+static int reap_cqes(uring_conn_t *c, __u64 tag, int *res)
+{
+    struct io_uring_cqe *cqe;
+    int found = 0;
+    while ((cqe = uring_peek_cqe(&c->ring)))
+    {
+        if (cqe->user_data == UD_RECV)
+            handle_recv_cqe(c, cqe);
+        if (cqe->user_data == tag && !found)
+        {
+            *res = cqe->res;
+            found = 1;
+        }
+        uring_cqe_seen(&c->ring);
+    }
+    return found;
+}
+
+// Send buf[off, size) with WRITE_FIXED from the registered buffer
+static int send_from(uring_conn_t *c, size_t off)
+{
+    while (off < c->size)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe(&c->ring);
+        if (!sqe)
+        {
+            errno = EBUSY;
+            return -1;
+        }
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->addr = (uintptr_t)(c->buf + off);
+        sqe->len = c->size - off;
+        sqe->off = 0; // sockets reject any other position
+        sqe->buf_index = 0;
+        sqe->user_data = UD_SEND;
+
+        int res = 0;
+        do
+        {
+            if (uring_submit_and_wait(&c->ring, 1) < 0)
+                return -1;
+        } while (!reap_cqes(c, UD_SEND, &res));
+        if (res <= 0)
+        {
+            errno = res < 0 ? -res : EPIPE;
+            return -1;
+        }
+        off += res;
+    }
+    return 0;
+}
+
+int uring_conn_init(uring_conn_t *c, int sockfd, char *buf, size_t size, int sqpoll)
+{
+    memset(c, 0, sizeof(*c));
+    c->ring.ring_fd = -1;
+    c->buf = buf;
+    c->size = size;
+
+    if (uring_init(&c->ring, URING_ENTRIES, sqpoll) < 0)
+        return -1;
+
+    // Registered file and buffer skip the per-op fd lookup and page pinning
+    if (sys_io_uring_register(c->ring.ring_fd, IORING_REGISTER_FILES, &sockfd, 1) < 0)
+        return -1;
+    struct iovec iov = {.iov_base = buf, .iov_len = size};
+    if (sys_io_uring_register(c->ring.ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        return -1;
+
+    // Provided buffer ring for the multishot recv
+    c->br_entries = URING_BR_ENTRIES;
+    c->br_buf_size = size < URING_BR_BUF_MAX ? size : URING_BR_BUF_MAX;
+    c->br_sz = c->br_entries * sizeof(struct io_uring_buf);
+    c->br = mmap(NULL, c->br_sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (c->br == MAP_FAILED)
+    {
+        c->br = NULL;
+        return -1;
+    }
+    c->br_bufs = malloc((size_t)c->br_entries * c->br_buf_size);
+    if (!c->br_bufs)
+        return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)c->br;
+    reg.ring_entries = c->br_entries;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(c->ring.ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -1;
+    for (unsigned bid = 0; bid < c->br_entries; bid++)
+        buf_ring_recycle(c, bid);
+    return 0;
+}
+
+int uring_conn_send(uring_conn_t *c)
+{
+    return send_from(c, 0);
+}
+
+int uring_conn_recv(uring_conn_t *c)
+{
+    int unused;
+    while (c->rx_have < c->size)
+    {
+        if (c->rx_eof)
+            return -1;
+        if (!c->recv_armed && arm_recv(c) < 0)
+            return -1;
+        if (uring_submit_and_wait(&c->ring, 1) < 0)
+            return -1;
+        reap_cqes(c, 0, &unused);
+    }
+    c->rx_have = 0;
+    return 0;
+}
+
+int uring_conn_echo(uring_conn_t *c)
+{
+    struct io_uring_sqe *recv_sqe = uring_get_sqe(&c->ring);
+    struct io_uring_sqe *send_sqe = uring_get_sqe(&c->ring);
+    if (!recv_sqe || !send_sqe)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    // A short recv (EOF or error) breaks the link and cancels the send
+    recv_sqe->opcode = IORING_OP_RECV;
+    recv_sqe->fd = 0;
+    recv_sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    recv_sqe->addr = (uintptr_t)c->buf;
+    recv_sqe->len = c->size;
+    recv_sqe->msg_flags = MSG_WAITALL;
+    recv_sqe->user_data = UD_ECHO_RECV;
+
+    send_sqe->opcode = IORING_OP_WRITE_FIXED;
+    send_sqe->fd = 0;
+    send_sqe->flags = IOSQE_FIXED_FILE;
+    send_sqe->addr = (uintptr_t)c->buf;
+    send_sqe->len = c->size;
+    send_sqe->off = 0;
+    send_sqe->buf_index = 0;
+    send_sqe->user_data = UD_SEND;
+
+    if (uring_submit_and_wait(&c->ring, 2) < 0)
+        return -1;
+
+    int recv_res = 0, send_res = 0;
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&c->ring)))
+    {
+        if (cqe->user_data == UD_ECHO_RECV)
+            recv_res = cqe->res;
+        else if (cqe->user_data == UD_SEND)
+            send_res = cqe->res;
+        uring_cqe_seen(&c->ring);
+    }
+    if (recv_res != (int)c->size)
+    {
+        errno = recv_res < 0 ? -recv_res : ECONNRESET;
+        return -1;
+    }
+    if (send_res < 0)
+    {
+        errno = -send_res;
+        return -1;
+    }
+    // Finish a short write outside the link
+    return send_from(c, (size_t)send_res);
+}
+
+uint64_t uring_conn_syscalls(const uring_conn_t *c)
+{
+    return c->ring.enters;
+}
+
+void uring_conn_close(uring_conn_t *c)
+{
+    uring_t *r = &c->ring;
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_sz);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_ring_sz);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED)
+        munmap(r->sq_ptr, r->sq_ring_sz);
+    if (r->ring_fd >= 0)
+        close(r->ring_fd);
+    if (c->br)
+        munmap(c->br, c->br_sz);
+    free(c->br_bufs);
+    memset(c, 0, sizeof(*c));
+    c->ring.ring_fd = -1;
+}
@@ -0,0 +1,78 @@
+#ifndef PINGPONG_URING_H
+#define PINGPONG_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring ring driven through the raw syscalls
+typedef struct uring
+{
+    int ring_fd;
+    int sqpoll; // kernel thread polls the SQ; completions are reaped by spinning
+
+    // submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_flags;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail; // SQEs queued up to here; published on submit
+
+    // completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_ring_sz;
+    size_t cq_ring_sz;
+    size_t sqes_sz;
+
+    uint64_t enters; // io_uring_enter calls made
+} uring_t;
+
+// Ping-pong connection on io_uring: the socket and the payload buffer are
+// registered, receives use multishot recv with a provided buffer ring
+typedef struct uring_conn
+{
+    uring_t ring;
+    char *buf;   // registered payload buffer (index 0)
+    size_t size; // message size
+
+    // provided buffer ring for multishot recv
+    struct io_uring_buf_ring *br;
+    size_t br_sz;
+    char *br_bufs;
+    unsigned br_entries;
+    unsigned br_buf_size;
+    unsigned br_tail;
+    int recv_armed;    // multishot recv is outstanding
+    size_t rx_have;    // bytes of the current message received so far
+    int rx_eof;        // peer closed or recv failed
+} uring_conn_t;
+
+// uring_conn_init sets up a ring for sockfd with buf registered as the payload
+// buffer. sqpoll selects SQPOLL mode. Returns -1 with errno set on failure.
+int uring_conn_init(uring_conn_t *c, int sockfd, char *buf, size_t size, int sqpoll);
+
+// uring_conn_send sends the whole payload buffer from the registered buffer
+int uring_conn_send(uring_conn_t *c);
+
+// uring_conn_recv receives one message into the payload buffer using the
+// multishot recv, re-arming it when the kernel ends it
+int uring_conn_recv(uring_conn_t *c);
+
+// uring_conn_echo receives one message and sends it back with a linked
+// recv -> send SQE pair, submitted and reaped with a single io_uring_enter
+int uring_conn_echo(uring_conn_t *c);
+
+// uring_conn_syscalls returns the io_uring_enter calls made so far
+uint64_t uring_conn_syscalls(const uring_conn_t *c);
+
+void uring_conn_close(uring_conn_t *c);
+
+#endif // PINGPONG_URING_H